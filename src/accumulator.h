@@ -0,0 +1,170 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef ACCUMULATOR_H_
+#define ACCUMULATOR_H_
+
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
+
+#include "compensated_summation.h"
+#include "superaccumulator.h"
+#include "reduction.h"
+
+namespace reduction {
+
+/**
+  * Running sum which values can be added to as they arrive, for online
+  * aggregation. The result can be read at any time without disturbing the
+  * sum, accumulators of different threads or processes can be merged, and
+  * the state can be serialized in a few bytes, e.g.
+  *
+  *     reduction::accumulator<reduction::kahan> sum;
+  *     sum.add(x);
+  *     sum.add_span(values, n);
+  *     sum.merge(other);
+  *     sum.result();
+  *
+  * add is a handful of instructions, while add_span uses the vectorized
+  * kernels, so it rounds differently from adding the values one by one.
+  * Algorithm is kahan, neumaier or exact.
+  */
+template <class Algorithm, typename T = double>
+class accumulator {
+    static_assert(std::is_same<Algorithm, kahan>::value || std::is_same<Algorithm, neumaier>::value,
+        "accumulator supports the kahan, neumaier and exact algorithms");
+
+public:
+    void add(const T& value_) {
+        if constexpr (std::is_same<Algorithm, kahan>::value) {
+            T y = value_ + state.error;
+            T t = state.sum + y;
+            state.error = y - (t - state.sum);
+            state.sum = t;
+        }
+        else {
+            T t = state.sum + value_;
+            state.error += (std::abs(state.sum) >= std::abs(value_)) ? (state.sum - t) + value_ : (value_ - t) + state.sum;
+            state.sum = t;
+        }
+    }
+
+    void add_span(const T* values_, size_t n_) {
+        if constexpr (std::is_same<Algorithm, kahan>::value) {
+            state = two_sum(state, kahan_sum_simd(values_, n_));
+        }
+        else {
+            state = two_sum(state, neumaier_sum_simd(values_, n_));
+        }
+    }
+
+    void merge(const accumulator& other_) {
+        state = two_sum(state, other_.state);
+    }
+
+    T result() const {
+        return state.value();
+    }
+
+    /**
+      * Writes the sum and the error term in the byte order of the host.
+      * Returns the number of bytes written.
+      */
+    size_t serialize(unsigned char* buffer_) const {
+        memcpy(buffer_, &state.sum, sizeof(T));
+        memcpy(buffer_ + sizeof(T), &state.error, sizeof(T));
+        return max_serialized_size;
+    }
+
+    /**
+      * Replaces the sum with one written by serialize. Returns the
+      * number of bytes read, or 0 if size_ is too small.
+      */
+    size_t deserialize(const unsigned char* buffer_, size_t size_) {
+        if (size_ < max_serialized_size) {
+            return 0;
+        }
+        memcpy(&state.sum, buffer_, sizeof(T));
+        memcpy(&state.error, buffer_ + sizeof(T), sizeof(T));
+        return max_serialized_size;
+    }
+
+    static const size_t max_serialized_size = 2*sizeof(T);
+
+private:
+    compensated<T> state;
+};
+
+/**
+  * Correctly rounded running sum of floats or doubles. Adding a value is
+  * a few TwoSums on a small expansion, which almost never spills into
+  * the superaccumulator, and the result is independent of the order
+  * of adds and merges.
+  */
+template <typename T>
+class accumulator<exact, T> {
+    static_assert(std::is_same<T, float>::value || std::is_same<T, double>::value,
+        "the exact accumulator supports float and double");
+
+public:
+    void add(const T& value_) {
+        state.add(static_cast<double>(value_));
+    }
+
+    void add_span(const T* values_, size_t n_) {
+        state.add(values_, n_);
+    }
+
+    void merge(const accumulator& other_) {
+        state.add(other_.state);
+    }
+
+    T result() const {
+        return state.template result<T>();
+    }
+
+    size_t serialize(unsigned char* buffer_) const {
+        return state.serialize(buffer_);
+    }
+
+    size_t deserialize(const unsigned char* buffer_, size_t size_) {
+        return state.deserialize(buffer_, size_);
+    }
+
+    static const size_t max_serialized_size = exact_accumulator::max_serialized_size;
+
+private:
+    exact_accumulator state;
+};
+
+} //namespace reduction
+
+#endif
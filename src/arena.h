@@ -0,0 +1,376 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <new>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <omp.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "numa.h"
+
+/**
+  * Pages backing the buffers of an arena
+  */
+enum page_mode {
+    PAGES_SMALL,       //Base pages (4 KiB on x86), with transparent huge pages turned off
+    PAGES_TRANSPARENT, //Transparent huge pages, requested with madvise(MADV_HUGEPAGE)
+    PAGES_EXPLICIT     //Reserved huge pages (MAP_HUGETLB), which need vm.nr_hugepages
+};
+
+inline const char* page_mode_name(page_mode mode_) {
+    switch (mode_) {
+    case PAGES_TRANSPARENT: return "transparent huge pages";
+    case PAGES_EXPLICIT: return "explicit huge pages";
+    default: return "small pages";
+    }
+}
+
+/**
+  * Page mode of the default arena, set with the environment variable
+  * ARENA_PAGES=small|transparent|explicit (default transparent)
+  */
+inline page_mode default_page_mode() {
+    const char* setting = getenv("ARENA_PAGES");
+    if (setting != NULL && strcmp(setting, "small") == 0) {
+        return PAGES_SMALL;
+    }
+    if (setting != NULL && strcmp(setting, "explicit") == 0) {
+        return PAGES_EXPLICIT;
+    }
+    return PAGES_TRANSPARENT;
+}
+
+/**
+  * Size and alignment of a huge page (2 MiB on x86-64)
+  */
+static const size_t huge_page_size = 2*1024*1024;
+
+/**
+  * Hands out large buffers which start on a huge page boundary (and so on
+  * any SIMD or cache line boundary), backed by the pages of mode(). Freed
+  * buffers are kept and handed out again to later requests that fit, so
+  * repeated benchmarks do not pay for page faults and zeroing each time.
+  * Explicit huge pages fall back to transparent ones if none are reserved.
+  */
+class arena {
+public:
+    explicit arena(page_mode mode_ = default_page_mode()) : pages(mode_) {}
+
+    ~arena() {
+        for (size_t i=0; i<blocks.size(); ++i) {
+            unmap(blocks[i]);
+        }
+    }
+
+    page_mode mode() const {
+        return pages;
+    }
+
+    /**
+      * Returns a buffer of at least bytes_ bytes, and sets fresh_
+      * if its pages have never been touched
+      */
+    void* allocate(size_t bytes_, bool& fresh_) {
+        std::lock_guard<std::mutex> lock(mutex);
+        block* best = NULL;
+        for (size_t i=0; i<blocks.size(); ++i) {
+            if (!blocks[i].in_use && blocks[i].bytes >= bytes_ && (best == NULL || blocks[i].bytes < best->bytes)) {
+                best = &blocks[i];
+            }
+        }
+        fresh_ = (best == NULL);
+        if (best == NULL) {
+            blocks.push_back(map((bytes_ + huge_page_size - 1) / huge_page_size * huge_page_size));
+            best = &blocks.back();
+        }
+        best->in_use = true;
+        return best->data;
+    }
+
+    void deallocate(void* data_) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i=0; i<blocks.size(); ++i) {
+            if (blocks[i].data == data_) {
+                blocks[i].in_use = false;
+            }
+        }
+    }
+
+    /**
+      * Returns the unused buffers to the operating system
+      */
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<block> kept;
+        for (size_t i=0; i<blocks.size(); ++i) {
+            if (blocks[i].in_use) {
+                kept.push_back(blocks[i]);
+            }
+            else {
+                unmap(blocks[i]);
+            }
+        }
+        blocks.swap(kept);
+    }
+
+private:
+    arena(const arena&);
+    arena& operator=(const arena&);
+
+    struct block {
+        char* data;
+        size_t bytes;
+        void* mapping;
+        size_t mapping_bytes;
+        bool in_use;
+    };
+
+    block map(size_t bytes_) {
+        block result = { NULL, bytes_, NULL, bytes_, false };
+#ifdef _WIN32
+        result.mapping = _aligned_malloc(bytes_, huge_page_size);
+        result.data = static_cast<char*>(result.mapping);
+#else
+#ifdef MAP_HUGETLB
+        if (pages == PAGES_EXPLICIT) {
+            void* mapping = mmap(NULL, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mapping != MAP_FAILED) {
+                result.mapping = mapping;
+                result.data = static_cast<char*>(mapping);
+                return result;
+            }
+        }
+#endif
+        if (pages == PAGES_EXPLICIT) {
+            pages = PAGES_TRANSPARENT;
+        }
+
+        //Map one huge page extra, so that the buffer can start on a huge page
+        result.mapping_bytes = bytes_ + huge_page_size;
+        void* mapping = mmap(NULL, result.mapping_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        result.mapping = mapping;
+        const size_t address = reinterpret_cast<size_t>(mapping);
+        result.data = reinterpret_cast<char*>((address + huge_page_size - 1) / huge_page_size * huge_page_size);
+#ifdef MADV_HUGEPAGE
+        madvise(result.data, bytes_, (pages == PAGES_SMALL) ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+#endif
+#endif
+        if (result.data == NULL) {
+            throw std::bad_alloc();
+        }
+        return result;
+    }
+
+    static void unmap(const block& block_) {
+#ifdef _WIN32
+        _aligned_free(block_.mapping);
+#else
+        munmap(block_.mapping, block_.mapping_bytes);
+#endif
+    }
+
+    page_mode pages;
+    std::vector<block> blocks;
+    std::mutex mutex;
+};
+
+/**
+  * Arena used by arena_allocator unless another one is given
+  */
+inline arena& default_arena() {
+    static arena instance;
+    return instance;
+}
+
+/**
+  * Allocator for large buffers from an arena. New pages are placed with
+  * a parallel first touch as in first_touch_allocator, and default
+  * construction leaves the elements uninitialized.
+  */
+template <typename T>
+class arena_allocator {
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef arena_allocator<U> other;
+    };
+
+    arena_allocator() : pool(&default_arena()) {}
+    explicit arena_allocator(arena& pool_) : pool(&pool_) {}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other_) : pool(other_.pool) {}
+
+    T* allocate(size_t n_) {
+        bool fresh;
+        char* buffer = static_cast<char*>(pool->allocate(n_*sizeof(T), fresh));
+        if (fresh && numa_first_touch_enabled()) {
+            #pragma omp parallel
+            {
+                size_t begin, end;
+                static_partition(n_, omp_get_thread_num(), omp_get_num_threads(), begin, end);
+                memset(buffer + begin*sizeof(T), 0, (end-begin)*sizeof(T));
+            }
+        }
+        return reinterpret_cast<T*>(buffer);
+    }
+
+    void deallocate(T* data_, size_t) {
+        pool->deallocate(data_);
+    }
+
+    template <typename U>
+    void construct(U* data_) {
+        ::new (static_cast<void*>(data_)) U;
+    }
+
+    template <typename U>
+    void construct(U* data_, const U& value_) {
+        ::new (static_cast<void*>(data_)) U(value_);
+    }
+
+    template <typename U>
+    void destroy(U* data_) {
+        data_->~U();
+    }
+
+    arena* pool;
+};
+
+template <typename T, typename U>
+bool operator==(const arena_allocator<T>& a_, const arena_allocator<U>& b_) {
+    return a_.pool == b_.pool;
+}
+
+template <typename T, typename U>
+bool operator!=(const arena_allocator<T>& a_, const arena_allocator<U>& b_) {
+    return a_.pool != b_.pool;
+}
+
+/**
+  * Resident set size of this process in bytes, or 0 if unknown
+  */
+inline size_t resident_set_bytes() {
+    size_t resident = 0;
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file != NULL) {
+        unsigned long pages_total, pages_resident;
+        if (fscanf(file, "%lu %lu", &pages_total, &pages_resident) == 2) {
+            resident = pages_resident * sysconf(_SC_PAGESIZE);
+        }
+        fclose(file);
+    }
+#endif
+    return resident;
+}
+
+/**
+  * Resident memory of the mapping which holds an address, split into
+  * base pages and huge pages (transparent or explicit)
+  */
+struct page_usage {
+    size_t resident_bytes;
+    size_t huge_bytes;
+
+    page_usage() : resident_bytes(0), huge_bytes(0) {}
+
+    size_t small_pages() const {
+        return (resident_bytes - huge_bytes) / 4096;
+    }
+
+    size_t huge_pages() const {
+        return huge_bytes / huge_page_size;
+    }
+};
+
+/**
+  * Reads the page usage of the mapping that holds address_ from
+  * /proc/self/smaps, or returns zeros if it is not available
+  */
+inline page_usage mapping_page_usage(const void* address_) {
+    page_usage usage;
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/smaps", "r");
+    if (file == NULL) {
+        return usage;
+    }
+    const unsigned long address = reinterpret_cast<unsigned long>(address_);
+    bool inside = false;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned long start, end;
+        char key[64];
+        unsigned long kilobytes;
+        //Each mapping starts with its address range, followed by its fields
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            if (inside) {
+                break;
+            }
+            inside = (start <= address && address < end);
+        }
+        else if (inside && sscanf(line, "%63s %lu kB", key, &kilobytes) == 2) {
+            const std::string name = key;
+            if (name == "Rss:") {
+                usage.resident_bytes += kilobytes*1024;
+            }
+            else if (name == "AnonHugePages:") {
+                usage.huge_bytes += kilobytes*1024;
+            }
+            else if (name == "Private_Hugetlb:" || name == "Shared_Hugetlb:") {
+                usage.resident_bytes += kilobytes*1024;
+                usage.huge_bytes += kilobytes*1024;
+            }
+        }
+    }
+    fclose(file);
+#endif
+    return usage;
+}
+
+#endif
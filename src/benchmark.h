@@ -0,0 +1,221 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+  * Returns a monotonic time stamp in seconds
+  */
+inline double benchmark_time() {
+#ifdef _WIN32
+    LARGE_INTEGER f;
+    LARGE_INTEGER t;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&t);
+    return t.QuadPart / static_cast<double>(f.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+#endif
+}
+
+/**
+  * Reads a non-negative integer setting from the environment
+  */
+inline int benchmark_env_setting(const char* name_, int default_value_) {
+    const char* value = getenv(name_);
+    if (value == NULL) {
+        return default_value_;
+    }
+    int result = atoi(value);
+    return (result < 0) ? default_value_ : result;
+}
+
+/**
+  * Timing statistics of one benchmark, all times in seconds
+  */
+struct benchmark_result {
+    std::string name;
+    std::string type;
+    int threads;
+    size_t elements;
+    size_t bytes;
+    int repetitions;
+    double min;
+    double median;
+    double p99;
+    double mean;
+
+    double gigabytes_per_second() const {
+        return bytes / median * 1.0e-9;
+    }
+
+    double elements_per_second() const {
+        return elements / median;
+    }
+};
+
+/**
+  * Collects the results of all benchmarks in a program. If BENCHMARK_FORMAT
+  * is json or csv, they are written to <program>.json or <program>.csv in
+  * the directory BENCHMARK_DIR (default the current directory).
+  */
+class benchmark_reporter {
+public:
+    void add(const benchmark_result& result_) {
+        results.push_back(result_);
+    }
+
+    void write(const std::string& program_) const {
+        const char* format = getenv("BENCHMARK_FORMAT");
+        if (format == NULL || (std::string(format) != "json" && std::string(format) != "csv")) {
+            return;
+        }
+        const char* directory = getenv("BENCHMARK_DIR");
+        const std::string filename = std::string((directory != NULL) ? directory : ".") + "/" + program_ + "." + format;
+        std::ofstream file(filename.c_str());
+        if (!file) {
+            std::cerr << "Could not open " << filename << " for writing" << std::endl;
+            return;
+        }
+        file << std::setprecision(9);
+        if (std::string(format) == "csv") {
+            file << "program,name,type,threads,elements,bytes,repetitions,min_s,median_s,p99_s,mean_s,gb_per_s,elements_per_s" << std::endl;
+            for (size_t i=0; i<results.size(); ++i) {
+                const benchmark_result& r = results[i];
+                file << program_ << "," << r.name << "," << r.type << "," << r.threads << ","
+                     << r.elements << "," << r.bytes << "," << r.repetitions << ","
+                     << r.min << "," << r.median << "," << r.p99 << "," << r.mean << ","
+                     << r.gigabytes_per_second() << "," << r.elements_per_second() << std::endl;
+            }
+        }
+        else {
+            file << "{\"program\": \"" << program_ << "\", \"benchmarks\": [" << std::endl;
+            for (size_t i=0; i<results.size(); ++i) {
+                const benchmark_result& r = results[i];
+                file << "  {\"name\": \"" << r.name << "\", \"type\": \"" << r.type << "\", "
+                     << "\"threads\": " << r.threads << ", \"elements\": " << r.elements << ", "
+                     << "\"bytes\": " << r.bytes << ", \"repetitions\": " << r.repetitions << ", "
+                     << "\"min_s\": " << r.min << ", \"median_s\": " << r.median << ", "
+                     << "\"p99_s\": " << r.p99 << ", \"mean_s\": " << r.mean << ", "
+                     << "\"gb_per_s\": " << r.gigabytes_per_second() << ", "
+                     << "\"elements_per_s\": " << r.elements_per_second() << "}"
+                     << ((i+1 < results.size()) ? "," : "") << std::endl;
+            }
+            file << "]}" << std::endl;
+        }
+    }
+
+private:
+    std::vector<benchmark_result> results;
+};
+
+inline benchmark_reporter& benchmark_report() {
+    static benchmark_reporter reporter;
+    return reporter;
+}
+
+/**
+  * Runs function_ BENCHMARK_WARMUP times (default 1) without timing, and
+  * then BENCHMARK_REPETITIONS times (default 5) with timing. The value
+  * returned by the last run is stored in result_, so that the compiler
+  * cannot remove the work. The statistics are printed, and added to the
+  * report. Set bytes_ to zero if no memory is streamed.
+  */
+template <typename R, class F>
+benchmark_result run_benchmark(const std::string& name_, const std::string& type_,
+        size_t elements_, size_t bytes_, F function_, R& result_) {
+    const int warmup = benchmark_env_setting("BENCHMARK_WARMUP", 1);
+    const int repetitions = std::max(1, benchmark_env_setting("BENCHMARK_REPETITIONS", 5));
+
+    for (int i=0; i<warmup; ++i) {
+        result_ = function_();
+    }
+    std::vector<double> times(repetitions);
+    for (int i=0; i<repetitions; ++i) {
+        double start = benchmark_time();
+        result_ = function_();
+        times[i] = benchmark_time() - start;
+    }
+    std::sort(times.begin(), times.end());
+
+    benchmark_result result;
+    result.name = name_;
+    result.type = type_;
+#ifdef _OPENMP
+    result.threads = omp_get_max_threads();
+#else
+    result.threads = 1;
+#endif
+    result.elements = elements_;
+    result.bytes = bytes_;
+    result.repetitions = repetitions;
+    result.min = times.front();
+    result.median = (repetitions % 2 == 1) ? times[repetitions/2] : 0.5*(times[repetitions/2-1] + times[repetitions/2]);
+    result.p99 = times[static_cast<int>(std::ceil(0.99*repetitions)) - 1];
+    result.mean = 0.0;
+    for (int i=0; i<repetitions; ++i) {
+        result.mean += times[i] / repetitions;
+    }
+    benchmark_report().add(result);
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(6);
+    line << "`-> " << name_ << " (" << type_ << "): min " << result.min << " s, median " << result.median
+         << " s, p99 " << result.p99 << " s, " << std::setprecision(1) << result.elements_per_second()*1.0e-6 << " M elements/s";
+    if (bytes_ > 0) {
+        line << ", " << std::setprecision(2) << result.gigabytes_per_second() << " GB/s";
+    }
+    std::cout << line.str() << std::endl;
+    return result;
+}
+
+#endif
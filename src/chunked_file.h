@@ -0,0 +1,249 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef CHUNKED_FILE_H_
+#define CHUNKED_FILE_H_
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <stdexcept>
+#include <algorithm>
+
+#include "numa.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+/**
+  * How for_each_chunk gets the file into memory: By mapping the file
+  * and letting the kernel read ahead, or by reading each chunk into a
+  * buffer in a background thread while the previous chunk is reduced
+  */
+enum chunk_read_mode {
+    CHUNK_MMAP,
+    CHUNK_READ
+};
+
+inline const char* chunk_read_mode_name(chunk_read_mode mode_) {
+    switch (mode_) {
+    case CHUNK_MMAP: return "mmap";
+    case CHUNK_READ: return "read";
+    }
+    return "unknown";
+}
+
+/**
+  * Drops the pages of a file from the page cache, so that the
+  * next pass over it is read from disk
+  */
+inline void evict_file_cache(const std::string& filename_) {
+#ifndef _WIN32
+    const int fd = open(filename_.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+namespace detail {
+
+/**
+  * Joins a thread when it goes out of scope, also when an exception is thrown
+  */
+struct thread_joiner {
+    std::thread& thread;
+
+    explicit thread_joiner(std::thread& thread_) : thread(thread_) {}
+    ~thread_joiner() {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+};
+
+/**
+  * Reads a file with two buffers of chunk_elements_ values: While f_
+  * reduces one chunk, a background thread reads the next into the other.
+  * Every chunk but the last is full, so a short read is an error and
+  * not the end of the file, and is reported before f_ sees the chunk.
+  */
+template <typename T, class F>
+size_t for_each_chunk_read(const std::string& filename_, size_t chunk_elements_, F f_) {
+    FILE* file = fopen(filename_.c_str(), "rb");
+    if (file == NULL) {
+        throw std::runtime_error("Could not open " + filename_);
+    }
+#ifdef _WIN32
+    struct _stat64 status;
+    const bool sized = (_fstat64(_fileno(file), &status) == 0);
+#else
+    struct stat status;
+    const bool sized = (fstat(fileno(file), &status) == 0);
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    if (!sized) {
+        fclose(file);
+        throw std::runtime_error("Could not stat " + filename_);
+    }
+    const size_t n = status.st_size / sizeof(T);
+
+    std::vector<T, first_touch_allocator<T> > buffers[2];
+    buffers[0].resize(chunk_elements_);
+    buffers[1].resize(chunk_elements_);
+    size_t counts[2] = {0, 0};
+    bool short_read[2] = {false, false};
+    size_t total = 0;
+
+    auto read_chunk = [&](int buffer_, size_t begin_) {
+        const size_t wanted = std::min(chunk_elements_, n - begin_);
+        counts[buffer_] = fread(buffers[buffer_].data(), sizeof(T), wanted, file);
+        short_read[buffer_] = (counts[buffer_] != wanted);
+    };
+
+    try {
+        read_chunk(0, 0);
+        for (int current = 0; counts[current] > 0 && !short_read[current]; current = 1-current) {
+            std::thread reader(read_chunk, 1-current, total + counts[current]);
+            thread_joiner joiner(reader);
+            f_(static_cast<const T*>(buffers[current].data()), counts[current]);
+            total += counts[current];
+        }
+    }
+    catch (...) {
+        fclose(file);
+        throw;
+    }
+
+    const bool failed = (ferror(file) != 0 || total != n);
+    fclose(file);
+    if (failed) {
+        throw std::runtime_error("Could not read " + filename_);
+    }
+    return total;
+}
+
+#ifndef _WIN32
+/**
+  * Unmaps a mapping when it goes out of scope, also when an exception is thrown
+  */
+struct mapping_guard {
+    void* mapping;
+    size_t bytes;
+
+    mapping_guard(void* mapping_, size_t bytes_) : mapping(mapping_), bytes(bytes_) {}
+    ~mapping_guard() {
+        munmap(mapping, bytes);
+    }
+};
+
+/**
+  * Maps a file and walks through it one chunk at a time: The kernel
+  * is asked to read the next chunk ahead while the current one is
+  * reduced, and the pages of finished chunks are released again,
+  * so that the resident memory stays at about two chunks
+  */
+template <typename T, class F>
+size_t for_each_chunk_mmap(const std::string& filename_, size_t chunk_elements_, F f_) {
+    const int fd = open(filename_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open " + filename_);
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        throw std::runtime_error("Could not stat " + filename_);
+    }
+    const size_t n = status.st_size / sizeof(T);
+    if (n == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void* mapping = mmap(NULL, n*sizeof(T), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Could not map " + filename_);
+    }
+    mapping_guard guard(mapping, n*sizeof(T));
+    madvise(mapping, n*sizeof(T), MADV_SEQUENTIAL);
+
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    char* bytes = static_cast<char*>(mapping);
+    const T* values = static_cast<const T*>(mapping);
+    for (size_t begin = 0; begin < n; begin += chunk_elements_) {
+        const size_t end = std::min(begin + chunk_elements_, n);
+        if (end < n) {
+            const size_t next_begin = (end*sizeof(T)) / page_size * page_size;
+            const size_t next_end = std::min(end + chunk_elements_, n)*sizeof(T);
+            madvise(bytes + next_begin, next_end - next_begin, MADV_WILLNEED);
+        }
+
+        f_(values + begin, end - begin);
+
+        const size_t done_begin = (begin*sizeof(T)) / page_size * page_size;
+        const size_t done_end = (end*sizeof(T)) / page_size * page_size;
+        if (done_end > done_begin) {
+            madvise(bytes + done_begin, done_end - done_begin, MADV_DONTNEED);
+        }
+    }
+    return n;
+}
+#endif
+
+} //namespace detail
+
+/**
+  * Calls f_(values, n) for consecutive chunks of at most chunk_elements_
+  * values of type T stored in a raw binary file, and returns the total
+  * number of values. Trailing bytes which do not make up a whole value
+  * are ignored. Only two chunks are in memory at any time.
+  */
+template <typename T, class F>
+size_t for_each_chunk(const std::string& filename_, size_t chunk_elements_, chunk_read_mode mode_, F f_) {
+#ifndef _WIN32
+    if (mode_ == CHUNK_MMAP) {
+        return detail::for_each_chunk_mmap<T>(filename_, chunk_elements_, f_);
+    }
+#endif
+    return detail::for_each_chunk_read<T>(filename_, chunk_elements_, f_);
+}
+
+#endif
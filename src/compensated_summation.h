@@ -0,0 +1,584 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef COMPENSATED_SUMMATION_H_
+#define COMPENSATED_SUMMATION_H_
+
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COMPENSATED_SUMMATION_X86 1
+#include <immintrin.h>
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#define SIMD_KERNEL(isa) __attribute__((target(isa), flatten))
+#elif defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define COMPENSATED_SUMMATION_X86 1
+#include <immintrin.h>
+#define SIMD_TARGET(isa)
+#define SIMD_KERNEL(isa)
+#endif
+
+#ifdef __GNUC__
+//The vector types only ever live inside the kernels which are compiled
+//for the matching instruction set, so the ABI note does not apply
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+/**
+  * A compensated sum, where the represented value is sum + error
+  */
+template <typename T>
+struct compensated {
+    T sum;
+    T error;
+
+    compensated() : sum(0.0), error(0.0) {}
+    compensated(const T& sum_, const T& error_) : sum(sum_), error(error_) {}
+
+    T value() const {
+        return sum + error;
+    }
+};
+
+/**
+  * Adds two compensated sums using TwoSum, so that the rounding
+  * error of adding the two sums is kept in the error term
+  */
+template <typename T>
+compensated<T> two_sum(const compensated<T>& a_, const compensated<T>& b_) {
+    T sum = a_.sum + b_.sum;
+    T b_virtual = sum - a_.sum;
+    T a_virtual = sum - b_virtual;
+    T error = (a_.sum - a_virtual) + (b_.sum - b_virtual);
+    return compensated<T>(sum, error + (a_.error + b_.error));
+}
+
+/**
+  * State of a compensated summation which is split into a fixed number
+  * of independent lanes. Element i is always added to lane i % lanes, so
+  * the result is bit-identical regardless of which instruction set does the
+  * work, and summation can continue chunk by chunk as long as all chunks but
+  * the last have a length that is a multiple of lanes.
+  */
+template <typename T>
+struct compensated_lanes {
+    static const int lanes = 128 / sizeof(T);
+    T sum[lanes];
+    T error[lanes];
+
+    compensated_lanes() {
+        for (int i=0; i<lanes; ++i) {
+            sum[i] = 0.0;
+            error[i] = 0.0;
+        }
+    }
+
+    /**
+      * Folds the lanes in a fixed order into a single compensated sum
+      */
+    compensated<T> result() const {
+        compensated<T> result;
+        for (int i=0; i<lanes; ++i) {
+            result = two_sum(result, compensated<T>(sum[i], error[i]));
+        }
+        return result;
+    }
+};
+
+namespace detail {
+
+/**
+  * Kahan summation per lane. The compensation is kept with the
+  * opposite sign of the textbook formulation so that the represented
+  * value is sum + error, which gives exactly the same roundings.
+  * The values can be of a narrower type S than the sum.
+  */
+template <typename T, typename S>
+void kahan_accumulate_scalar(compensated_lanes<T>& state_, const S* values_, size_t n_) {
+    const int lanes = compensated_lanes<T>::lanes;
+    for (size_t i=0; i<n_; i+=lanes) {
+        const int count = (n_-i < static_cast<size_t>(lanes)) ? static_cast<int>(n_-i) : lanes;
+        for (int j=0; j<count; ++j) {
+            T y = static_cast<T>(values_[i+j]) + state_.error[j];
+            T t = state_.sum[j] + y;
+            state_.error[j] = y - (t - state_.sum[j]);
+            state_.sum[j] = t;
+        }
+    }
+}
+
+/**
+  * Plain summation per lane of values of a narrower type S,
+  * where the error terms are left untouched
+  */
+template <typename T, typename S>
+void sum_accumulate_scalar(compensated_lanes<T>& state_, const S* values_, size_t n_) {
+    const int lanes = compensated_lanes<T>::lanes;
+    for (size_t i=0; i<n_; i+=lanes) {
+        const int count = (n_-i < static_cast<size_t>(lanes)) ? static_cast<int>(n_-i) : lanes;
+        for (int j=0; j<count; ++j) {
+            state_.sum[j] += static_cast<T>(values_[i+j]);
+        }
+    }
+}
+
+/**
+  * Neumaier summation per lane, which unlike Kahan also handles
+  * values that are larger in magnitude than the running sum
+  */
+template <typename T>
+void neumaier_accumulate_scalar(compensated_lanes<T>& state_, const T* values_, size_t n_) {
+    const int lanes = compensated_lanes<T>::lanes;
+    for (size_t i=0; i<n_; i+=lanes) {
+        const int count = (n_-i < static_cast<size_t>(lanes)) ? static_cast<int>(n_-i) : lanes;
+        for (int j=0; j<count; ++j) {
+            T s = state_.sum[j];
+            T x = values_[i+j];
+            T t = s + x;
+            T s_abs = (s < 0) ? -s : s;
+            T x_abs = (x < 0) ? -x : x;
+            state_.error[j] += (s_abs >= x_abs) ? (s - t) + x : (x - t) + s;
+            state_.sum[j] = t;
+        }
+    }
+}
+
+#ifdef COMPENSATED_SUMMATION_X86
+
+/**
+  * Thin wrappers around the intrinsics for each instruction set,
+  * so that the kernels below can be written once. The double
+  * versions can also load floats, converted to double.
+  */
+struct sse2_float {
+    typedef __m128 vec;
+    static const int width = 4;
+    static inline vec load(const float* p_) { return _mm_loadu_ps(p_); }
+    static inline void store(float* p_, vec a_) { _mm_storeu_ps(p_, a_); }
+    static inline vec add(vec a_, vec b_) { return _mm_add_ps(a_, b_); }
+    static inline vec sub(vec a_, vec b_) { return _mm_sub_ps(a_, b_); }
+    static inline vec set1(float a_) { return _mm_set1_ps(a_); }
+    static inline vec mul(vec a_, vec b_) { return _mm_mul_ps(a_, b_); }
+    static inline vec min(vec a_, vec b_) { return _mm_min_ps(a_, b_); }
+    static inline vec max(vec a_, vec b_) { return _mm_max_ps(a_, b_); }
+    static inline vec neumaier_term(vec s_, vec x_, vec t_) {
+        const vec sign = _mm_set1_ps(-0.0f);
+        vec mask = _mm_cmpge_ps(_mm_andnot_ps(sign, s_), _mm_andnot_ps(sign, x_));
+        vec big = _mm_or_ps(_mm_and_ps(mask, s_), _mm_andnot_ps(mask, x_));
+        vec small = _mm_or_ps(_mm_and_ps(mask, x_), _mm_andnot_ps(mask, s_));
+        return _mm_add_ps(_mm_sub_ps(big, t_), small);
+    }
+};
+
+struct sse2_double {
+    typedef __m128d vec;
+    static const int width = 2;
+    static inline vec load(const double* p_) { return _mm_loadu_pd(p_); }
+    static inline vec load(const float* p_) { return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p_)))); }
+    static inline void store(double* p_, vec a_) { _mm_storeu_pd(p_, a_); }
+    static inline vec add(vec a_, vec b_) { return _mm_add_pd(a_, b_); }
+    static inline vec sub(vec a_, vec b_) { return _mm_sub_pd(a_, b_); }
+    static inline vec set1(double a_) { return _mm_set1_pd(a_); }
+    static inline vec mul(vec a_, vec b_) { return _mm_mul_pd(a_, b_); }
+    static inline vec min(vec a_, vec b_) { return _mm_min_pd(a_, b_); }
+    static inline vec max(vec a_, vec b_) { return _mm_max_pd(a_, b_); }
+    static inline vec neumaier_term(vec s_, vec x_, vec t_) {
+        const vec sign = _mm_set1_pd(-0.0);
+        vec mask = _mm_cmpge_pd(_mm_andnot_pd(sign, s_), _mm_andnot_pd(sign, x_));
+        vec big = _mm_or_pd(_mm_and_pd(mask, s_), _mm_andnot_pd(mask, x_));
+        vec small = _mm_or_pd(_mm_and_pd(mask, x_), _mm_andnot_pd(mask, s_));
+        return _mm_add_pd(_mm_sub_pd(big, t_), small);
+    }
+};
+
+struct avx2_float {
+    typedef __m256 vec;
+    static const int width = 8;
+    static inline SIMD_TARGET("avx2") vec load(const float* p_) { return _mm256_loadu_ps(p_); }
+    static inline SIMD_TARGET("avx2") void store(float* p_, vec a_) { _mm256_storeu_ps(p_, a_); }
+    static inline SIMD_TARGET("avx2") vec add(vec a_, vec b_) { return _mm256_add_ps(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec sub(vec a_, vec b_) { return _mm256_sub_ps(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec set1(float a_) { return _mm256_set1_ps(a_); }
+    static inline SIMD_TARGET("avx2") vec mul(vec a_, vec b_) { return _mm256_mul_ps(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec min(vec a_, vec b_) { return _mm256_min_ps(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec max(vec a_, vec b_) { return _mm256_max_ps(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec neumaier_term(vec s_, vec x_, vec t_) {
+        const vec sign = _mm256_set1_ps(-0.0f);
+        vec mask = _mm256_cmp_ps(_mm256_andnot_ps(sign, s_), _mm256_andnot_ps(sign, x_), _CMP_GE_OQ);
+        vec big = _mm256_blendv_ps(x_, s_, mask);
+        vec small = _mm256_blendv_ps(s_, x_, mask);
+        return _mm256_add_ps(_mm256_sub_ps(big, t_), small);
+    }
+};
+
+struct avx2_double {
+    typedef __m256d vec;
+    static const int width = 4;
+    static inline SIMD_TARGET("avx2") vec load(const double* p_) { return _mm256_loadu_pd(p_); }
+    static inline SIMD_TARGET("avx2") vec load(const float* p_) { return _mm256_cvtps_pd(_mm_loadu_ps(p_)); }
+    static inline SIMD_TARGET("avx2") void store(double* p_, vec a_) { _mm256_storeu_pd(p_, a_); }
+    static inline SIMD_TARGET("avx2") vec add(vec a_, vec b_) { return _mm256_add_pd(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec sub(vec a_, vec b_) { return _mm256_sub_pd(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec set1(double a_) { return _mm256_set1_pd(a_); }
+    static inline SIMD_TARGET("avx2") vec mul(vec a_, vec b_) { return _mm256_mul_pd(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec min(vec a_, vec b_) { return _mm256_min_pd(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec max(vec a_, vec b_) { return _mm256_max_pd(a_, b_); }
+    static inline SIMD_TARGET("avx2") vec neumaier_term(vec s_, vec x_, vec t_) {
+        const vec sign = _mm256_set1_pd(-0.0);
+        vec mask = _mm256_cmp_pd(_mm256_andnot_pd(sign, s_), _mm256_andnot_pd(sign, x_), _CMP_GE_OQ);
+        vec big = _mm256_blendv_pd(x_, s_, mask);
+        vec small = _mm256_blendv_pd(s_, x_, mask);
+        return _mm256_add_pd(_mm256_sub_pd(big, t_), small);
+    }
+};
+
+struct avx512_float {
+    typedef __m512 vec;
+    static const int width = 16;
+    static inline SIMD_TARGET("avx512f") vec load(const float* p_) { return _mm512_loadu_ps(p_); }
+    static inline SIMD_TARGET("avx512f") void store(float* p_, vec a_) { _mm512_storeu_ps(p_, a_); }
+    static inline SIMD_TARGET("avx512f") vec add(vec a_, vec b_) { return _mm512_add_ps(a_, b_); }
+    static inline SIMD_TARGET("avx512f") vec sub(vec a_, vec b_) { return _mm512_sub_ps(a_, b_); }
+    static inline SIMD_TARGET("avx512f") vec set1(float a_) { return _mm512_set1_ps(a_); }
+    //The explicit rounding mode keeps the compiler from fusing a product
+    //and a following add into an FMA, which the other kernels do not have
+    static inline SIMD_TARGET("avx512f") vec mul(vec a_, vec b_) { return _mm512_mul_round_ps(a_, b_, _MM_FROUND_CUR_DIRECTION); }
+    static inline SIMD_TARGET("avx512f") vec min(vec a_, vec b_) { return _mm512_min_ps(a_, b_); }
+    static inline SIMD_TARGET("avx512f") vec max(vec a_, vec b_) { return _mm512_max_ps(a_, b_); }
+    static inline SIMD_TARGET("avx512f") vec neumaier_term(vec s_, vec x_, vec t_) {
+        __mmask16 mask = _mm512_cmp_ps_mask(_mm512_abs_ps(s_), _mm512_abs_ps(x_), _CMP_GE_OQ);
+        vec big = _mm512_mask_blend_ps(mask, x_, s_);
+        vec small = _mm512_mask_blend_ps(mask, s_, x_);
+        return _mm512_add_ps(_mm512_sub_ps(big, t_), small);
+    }
+};
+
+struct avx512_double {
+    typedef __m512d vec;
+    static const int width = 8;
+    static inline SIMD_TARGET("avx512f") vec load(const double* p_) { return _mm512_loadu_pd(p_); }
+    static inline SIMD_TARGET("avx512f") vec load(const float* p_) { return _mm512_cvtps_pd(_mm256_loadu_ps(p_)); }
+    static inline SIMD_TARGET("avx512f") void store(double* p_, vec a_) { _mm512_storeu_pd(p_, a_); }
+    static inline SIMD_TARGET("avx512f") vec add(vec a_, vec b_) { return _mm512_add_pd(a_, b_); }
+    static inline SIMD_TARGET("avx512f") vec sub(vec a_, vec b_) { return _mm512_sub_pd(a_, b_); }
+    static inline SIMD_TARGET("avx512f") vec set1(double a_) { return _mm512_set1_pd(a_); }
+    static inline SIMD_TARGET("avx512f") vec mul(vec a_, vec b_) { return _mm512_mul_round_pd(a_, b_, _MM_FROUND_CUR_DIRECTION); }
+    static inline SIMD_TARGET("avx512f") vec min(vec a_, vec b_) { return _mm512_min_pd(a_, b_); }
+    static inline SIMD_TARGET("avx512f") vec max(vec a_, vec b_) { return _mm512_max_pd(a_, b_); }
+    static inline SIMD_TARGET("avx512f") vec neumaier_term(vec s_, vec x_, vec t_) {
+        __mmask8 mask = _mm512_cmp_pd_mask(_mm512_abs_pd(s_), _mm512_abs_pd(x_), _CMP_GE_OQ);
+        vec big = _mm512_mask_blend_pd(mask, x_, s_);
+        vec small = _mm512_mask_blend_pd(mask, s_, x_);
+        return _mm512_add_pd(_mm512_sub_pd(big, t_), small);
+    }
+};
+
+/**
+  * Vectorized Kahan summation. Each register holds V::width of the
+  * lanes, and several registers are used so that the independent
+  * dependency chains can overlap in the pipeline.
+  */
+template <class V, typename T, typename S>
+inline void kahan_accumulate_simd(compensated_lanes<T>& state_, const S* values_, size_t n_) {
+    typedef typename V::vec vec;
+    const int lanes = compensated_lanes<T>::lanes;
+    const int registers = lanes / V::width;
+
+    vec sum[registers];
+    vec error[registers];
+    for (int j=0; j<registers; ++j) {
+        sum[j] = V::load(state_.sum + j*V::width);
+        error[j] = V::load(state_.error + j*V::width);
+    }
+
+    size_t i = 0;
+    for (; i+lanes<=n_; i+=lanes) {
+        for (int j=0; j<registers; ++j) {
+            vec y = V::add(V::load(values_ + i + j*V::width), error[j]);
+            vec t = V::add(sum[j], y);
+            error[j] = V::sub(y, V::sub(t, sum[j]));
+            sum[j] = t;
+        }
+    }
+
+    for (int j=0; j<registers; ++j) {
+        V::store(state_.sum + j*V::width, sum[j]);
+        V::store(state_.error + j*V::width, error[j]);
+    }
+    kahan_accumulate_scalar(state_, values_ + i, n_ - i);
+}
+
+/**
+  * Vectorized plain summation in lanes, used to convert and add
+  * floats in double precision
+  */
+template <class V, typename T, typename S>
+inline void sum_accumulate_simd(compensated_lanes<T>& state_, const S* values_, size_t n_) {
+    typedef typename V::vec vec;
+    const int lanes = compensated_lanes<T>::lanes;
+    const int registers = lanes / V::width;
+
+    vec sum[registers];
+    for (int j=0; j<registers; ++j) {
+        sum[j] = V::load(state_.sum + j*V::width);
+    }
+
+    size_t i = 0;
+    for (; i+lanes<=n_; i+=lanes) {
+        for (int j=0; j<registers; ++j) {
+            sum[j] = V::add(sum[j], V::load(values_ + i + j*V::width));
+        }
+    }
+
+    for (int j=0; j<registers; ++j) {
+        V::store(state_.sum + j*V::width, sum[j]);
+    }
+    sum_accumulate_scalar(state_, values_ + i, n_ - i);
+}
+
+/**
+  * Vectorized Neumaier summation, see kahan_accumulate_simd
+  */
+template <class V, typename T>
+inline void neumaier_accumulate_simd(compensated_lanes<T>& state_, const T* values_, size_t n_) {
+    typedef typename V::vec vec;
+    const int lanes = compensated_lanes<T>::lanes;
+    const int registers = lanes / V::width;
+
+    vec sum[registers];
+    vec error[registers];
+    for (int j=0; j<registers; ++j) {
+        sum[j] = V::load(state_.sum + j*V::width);
+        error[j] = V::load(state_.error + j*V::width);
+    }
+
+    size_t i = 0;
+    for (; i+lanes<=n_; i+=lanes) {
+        for (int j=0; j<registers; ++j) {
+            vec x = V::load(values_ + i + j*V::width);
+            vec t = V::add(sum[j], x);
+            error[j] = V::add(error[j], V::neumaier_term(sum[j], x, t));
+            sum[j] = t;
+        }
+    }
+
+    for (int j=0; j<registers; ++j) {
+        V::store(state_.sum + j*V::width, sum[j]);
+        V::store(state_.error + j*V::width, error[j]);
+    }
+    neumaier_accumulate_scalar(state_, values_ + i, n_ - i);
+}
+
+/**
+  * Entry points compiled for each instruction set
+  */
+inline void kahan_sse2(compensated_lanes<float>& s_, const float* v_, size_t n_) { kahan_accumulate_simd<sse2_float>(s_, v_, n_); }
+inline void kahan_sse2(compensated_lanes<double>& s_, const double* v_, size_t n_) { kahan_accumulate_simd<sse2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx2") void kahan_avx2(compensated_lanes<float>& s_, const float* v_, size_t n_) { kahan_accumulate_simd<avx2_float>(s_, v_, n_); }
+inline SIMD_KERNEL("avx2") void kahan_avx2(compensated_lanes<double>& s_, const double* v_, size_t n_) { kahan_accumulate_simd<avx2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx512f") void kahan_avx512(compensated_lanes<float>& s_, const float* v_, size_t n_) { kahan_accumulate_simd<avx512_float>(s_, v_, n_); }
+inline SIMD_KERNEL("avx512f") void kahan_avx512(compensated_lanes<double>& s_, const double* v_, size_t n_) { kahan_accumulate_simd<avx512_double>(s_, v_, n_); }
+inline void kahan_sse2(compensated_lanes<double>& s_, const float* v_, size_t n_) { kahan_accumulate_simd<sse2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx2") void kahan_avx2(compensated_lanes<double>& s_, const float* v_, size_t n_) { kahan_accumulate_simd<avx2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx512f") void kahan_avx512(compensated_lanes<double>& s_, const float* v_, size_t n_) { kahan_accumulate_simd<avx512_double>(s_, v_, n_); }
+
+inline void sum_sse2(compensated_lanes<double>& s_, const float* v_, size_t n_) { sum_accumulate_simd<sse2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx2") void sum_avx2(compensated_lanes<double>& s_, const float* v_, size_t n_) { sum_accumulate_simd<avx2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx512f") void sum_avx512(compensated_lanes<double>& s_, const float* v_, size_t n_) { sum_accumulate_simd<avx512_double>(s_, v_, n_); }
+
+inline void neumaier_sse2(compensated_lanes<float>& s_, const float* v_, size_t n_) { neumaier_accumulate_simd<sse2_float>(s_, v_, n_); }
+inline void neumaier_sse2(compensated_lanes<double>& s_, const double* v_, size_t n_) { neumaier_accumulate_simd<sse2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx2") void neumaier_avx2(compensated_lanes<float>& s_, const float* v_, size_t n_) { neumaier_accumulate_simd<avx2_float>(s_, v_, n_); }
+inline SIMD_KERNEL("avx2") void neumaier_avx2(compensated_lanes<double>& s_, const double* v_, size_t n_) { neumaier_accumulate_simd<avx2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx512f") void neumaier_avx512(compensated_lanes<float>& s_, const float* v_, size_t n_) { neumaier_accumulate_simd<avx512_float>(s_, v_, n_); }
+inline SIMD_KERNEL("avx512f") void neumaier_avx512(compensated_lanes<double>& s_, const double* v_, size_t n_) { neumaier_accumulate_simd<avx512_double>(s_, v_, n_); }
+
+#endif
+
+} //namespace detail
+
+/**
+  * Instruction sets the compensated summation kernels can use
+  */
+enum simd_level {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2,
+    SIMD_AVX512 = 3
+};
+
+/**
+  * Returns the best instruction set supported by this CPU. Can be
+  * limited with set_simd_level, e.g., to compare the different kernels
+  */
+inline simd_level& simd_level_setting() {
+#if defined(COMPENSATED_SUMMATION_X86) && defined(__GNUC__)
+    static simd_level level = __builtin_cpu_supports("avx512f") ? SIMD_AVX512
+        : __builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_SSE2;
+#elif defined(COMPENSATED_SUMMATION_X86)
+    static simd_level level = SIMD_SSE2;
+#else
+    static simd_level level = SIMD_SCALAR;
+#endif
+    return level;
+}
+
+inline simd_level get_simd_level() {
+    return simd_level_setting();
+}
+
+/**
+  * Limits the instruction set used, but never above what the CPU supports
+  */
+inline void set_simd_level(simd_level level_) {
+    static const simd_level supported = simd_level_setting();
+    simd_level_setting() = (level_ < supported) ? level_ : supported;
+}
+
+inline const char* simd_level_name(simd_level level_) {
+    switch (level_) {
+    case SIMD_AVX512: return "AVX-512";
+    case SIMD_AVX2: return "AVX2";
+    case SIMD_SSE2: return "SSE2";
+    default: return "scalar";
+    }
+}
+
+/**
+  * Adds n_ values to a Kahan summation state. Types without a
+  * vectorized kernel (e.g., long double) use the scalar lanes
+  */
+template <typename T>
+void kahan_accumulate(compensated_lanes<T>& state_, const T* values_, size_t n_) {
+    detail::kahan_accumulate_scalar(state_, values_, n_);
+}
+
+template <typename T>
+void neumaier_accumulate(compensated_lanes<T>& state_, const T* values_, size_t n_) {
+    detail::neumaier_accumulate_scalar(state_, values_, n_);
+}
+
+#ifdef COMPENSATED_SUMMATION_X86
+template <typename T, typename S>
+void kahan_accumulate_dispatch(compensated_lanes<T>& state_, const S* values_, size_t n_) {
+    switch (get_simd_level()) {
+    case SIMD_AVX512: detail::kahan_avx512(state_, values_, n_); break;
+    case SIMD_AVX2: detail::kahan_avx2(state_, values_, n_); break;
+    case SIMD_SSE2: detail::kahan_sse2(state_, values_, n_); break;
+    default: detail::kahan_accumulate_scalar(state_, values_, n_); break;
+    }
+}
+
+template <typename T>
+void neumaier_accumulate_dispatch(compensated_lanes<T>& state_, const T* values_, size_t n_) {
+    switch (get_simd_level()) {
+    case SIMD_AVX512: detail::neumaier_avx512(state_, values_, n_); break;
+    case SIMD_AVX2: detail::neumaier_avx2(state_, values_, n_); break;
+    case SIMD_SSE2: detail::neumaier_sse2(state_, values_, n_); break;
+    default: detail::neumaier_accumulate_scalar(state_, values_, n_); break;
+    }
+}
+
+template <>
+inline void kahan_accumulate<float>(compensated_lanes<float>& state_, const float* values_, size_t n_) {
+    kahan_accumulate_dispatch(state_, values_, n_);
+}
+
+template <>
+inline void kahan_accumulate<double>(compensated_lanes<double>& state_, const double* values_, size_t n_) {
+    kahan_accumulate_dispatch(state_, values_, n_);
+}
+
+template <>
+inline void neumaier_accumulate<float>(compensated_lanes<float>& state_, const float* values_, size_t n_) {
+    neumaier_accumulate_dispatch(state_, values_, n_);
+}
+
+template <>
+inline void neumaier_accumulate<double>(compensated_lanes<double>& state_, const double* values_, size_t n_) {
+    neumaier_accumulate_dispatch(state_, values_, n_);
+}
+#endif
+
+/**
+  * Mixed precision: Adds n_ floats to a Kahan summation state in double
+  * precision, converting them in the vector registers, so that the values
+  * can be stored in half the memory but are summed far more accurately
+  */
+inline void kahan_accumulate(compensated_lanes<double>& state_, const float* values_, size_t n_) {
+#ifdef COMPENSATED_SUMMATION_X86
+    kahan_accumulate_dispatch(state_, values_, n_);
+#else
+    detail::kahan_accumulate_scalar(state_, values_, n_);
+#endif
+}
+
+/**
+  * Mixed precision: Adds n_ floats to the lanes of state_ in double
+  * precision without compensation
+  */
+inline void sum_accumulate(compensated_lanes<double>& state_, const float* values_, size_t n_) {
+#ifdef COMPENSATED_SUMMATION_X86
+    switch (get_simd_level()) {
+    case SIMD_AVX512: detail::sum_avx512(state_, values_, n_); break;
+    case SIMD_AVX2: detail::sum_avx2(state_, values_, n_); break;
+    case SIMD_SSE2: detail::sum_sse2(state_, values_, n_); break;
+    default: detail::sum_accumulate_scalar(state_, values_, n_); break;
+    }
+#else
+    detail::sum_accumulate_scalar(state_, values_, n_);
+#endif
+}
+
+/**
+  * Computes the Kahan compensated sum of n_ values
+  */
+template <typename T>
+compensated<T> kahan_sum_simd(const T* values_, size_t n_) {
+    compensated_lanes<T> state;
+    kahan_accumulate(state, values_, n_);
+    return state.result();
+}
+
+/**
+  * Computes the Neumaier compensated sum of n_ values
+  */
+template <typename T>
+compensated<T> neumaier_sum_simd(const T* values_, size_t n_) {
+    compensated_lanes<T> state;
+    neumaier_accumulate(state, values_, n_);
+    return state.result();
+}
+
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+#endif
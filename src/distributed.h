@@ -0,0 +1,423 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef DISTRIBUTED_H_
+#define DISTRIBUTED_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <stdint.h>
+#include <omp.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "reduction.h"
+
+/**
+  * Summation split over several worker processes on one machine, as a local
+  * stand-in for MPI. The values live in POSIX shared memory which every worker
+  * maps, and the workers get their ranges and send back their partial sums
+  * over Unix domain sockets. Each worker sums its range with the OpenMP
+  * reducers, so the total number of threads is not limited to one pool.
+  * POSIX only.
+  */
+namespace reduction {
+
+/**
+  * Array in POSIX shared memory, which worker processes can map
+  */
+template <typename T>
+class shared_array {
+public:
+    explicit shared_array(size_t size_) : values(NULL), count(size_) {
+        static int arrays = 0;
+        std::stringstream name;
+        name << "/reduction_" << getpid() << "_" << arrays++;
+        fd = shm_open(name.str().c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Could not create shared memory " + name.str());
+        }
+        shm_unlink(name.str().c_str());
+        if (count > 0) {
+            void* memory = MAP_FAILED;
+            if (ftruncate(fd, count*sizeof(T)) == 0) {
+                memory = mmap(NULL, count*sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            if (memory == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Could not map shared memory " + name.str());
+            }
+            values = static_cast<T*>(memory);
+        }
+    }
+
+    ~shared_array() {
+        if (values != NULL) {
+            munmap(values, count*sizeof(T));
+        }
+        close(fd);
+    }
+
+    T* data() { return values; }
+    const T* data() const { return values; }
+    size_t size() const { return count; }
+    T& operator[](size_t i_) { return values[i_]; }
+    const T& operator[](size_t i_) const { return values[i_]; }
+
+    /**
+      * Descriptor of the shared memory, which is closed on exec
+      */
+    int descriptor() const { return fd; }
+
+private:
+    shared_array(const shared_array&);
+    shared_array& operator=(const shared_array&);
+
+    T* values;
+    size_t count;
+    int fd;
+};
+
+namespace detail {
+
+/**
+  * Identifies the algorithm in a request to a worker
+  */
+template <class Algorithm> struct algorithm_id;
+template <> struct algorithm_id<naive> { static const uint32_t value = 0; };
+template <> struct algorithm_id<pairwise> { static const uint32_t value = 1; };
+template <> struct algorithm_id<kahan> { static const uint32_t value = 2; };
+template <> struct algorithm_id<neumaier> { static const uint32_t value = 3; };
+template <> struct algorithm_id<exact> { static const uint32_t value = 4; };
+template <> struct algorithm_id<cascade> { static const uint32_t value = 5; };
+
+/**
+  * Asks a worker to sum the values in [begin, end)
+  */
+struct worker_request {
+    uint32_t algorithm;
+    uint64_t begin;
+    uint64_t end;
+};
+
+static const char worker_flag[] = "--reduction-worker";
+
+inline bool read_all(int fd_, void* buffer_, size_t bytes_) {
+    char* buffer = static_cast<char*>(buffer_);
+    while (bytes_ > 0) {
+        const ssize_t read_bytes = read(fd_, buffer, bytes_);
+        if (read_bytes <= 0) {
+            return false;
+        }
+        buffer += read_bytes;
+        bytes_ -= read_bytes;
+    }
+    return true;
+}
+
+inline bool write_all(int fd_, const void* buffer_, size_t bytes_) {
+    const char* buffer = static_cast<const char*>(buffer_);
+    while (bytes_ > 0) {
+        const ssize_t written = send(fd_, buffer, bytes_, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return false;
+        }
+        buffer += written;
+        bytes_ -= written;
+    }
+    return true;
+}
+
+/**
+  * Computes the partial state of the values in [first_, last_) which the
+  * coordinator merges: the sum for naive, the sum and error term for the
+  * compensated algorithms, the block sums for pairwise and cascade, and
+  * the serialized exact accumulator for exact
+  */
+template <class Algorithm, typename T>
+std::vector<unsigned char> worker_partial(const T* first_, const T* last_) {
+    std::vector<unsigned char> partial;
+    if constexpr (std::is_same<Algorithm, naive>::value) {
+        const T sum = reduce<naive, openmp>(first_, last_);
+        partial.resize(sizeof(sum));
+        memcpy(partial.data(), &sum, sizeof(sum));
+    }
+    else if constexpr (is_blocked<Algorithm>::value) {
+        const size_t n = last_ - first_;
+        const long num_blocks = (n + pairwise_block_size - 1) / pairwise_block_size;
+        std::vector<T> block_results(num_blocks);
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i<num_blocks; ++i) {
+            block_results[i] = block_sum<Algorithm, T>(first_, n, i);
+        }
+        partial.resize(num_blocks*sizeof(T));
+        memcpy(partial.data(), block_results.data(), partial.size());
+    }
+    else if constexpr (std::is_same<Algorithm, exact>::value) {
+        partial.resize(exact_accumulator::max_serialized_size);
+        partial.resize(exact_accumulate(first_, last_, true).serialize(partial.data()));
+    }
+    else {
+        const compensated<T> sum = parallel_compensated_sum<Algorithm, T>(first_, last_);
+        partial.resize(sizeof(sum));
+        memcpy(partial.data(), &sum, sizeof(sum));
+    }
+    return partial;
+}
+
+} //namespace detail
+
+/**
+  * Worker processes which sum parts of a shared array. The processes are
+  * started once, by running this program again (through /proc/self/exe)
+  * with arguments which serve_if_worker recognizes, so main has to call it
+  * first. Each call to reduce splits the array into whole pairwise blocks,
+  * one contiguous range per worker, and merges the partial sums in worker
+  * order: The pairwise, cascade and exact sums are identical to reduce on
+  * the whole array for any number of workers, while the others depend on
+  * the number of workers (but not on timing).
+  */
+template <typename T>
+class process_group {
+public:
+    /**
+      * Starts workers_ processes, each with threads_ OpenMP threads
+      * (0 for the OpenMP default)
+      */
+    process_group(const shared_array<T>& values_, int workers_, int threads_ = 0) : values(values_) {
+        for (int i=0; i<workers_; ++i) {
+            int sockets[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) {
+                stop();
+                throw std::runtime_error("Could not create a socket for a worker");
+            }
+
+            std::stringstream data, size, socket, threads;
+            data << values.descriptor();
+            size << values.size();
+            socket << sockets[1];
+            threads << threads_;
+            const std::string arguments[5] = { detail::worker_flag, data.str(), size.str(), socket.str(), threads.str() };
+
+            const pid_t pid = fork();
+            if (pid == 0) {
+                //Only what is safe between fork and exec in a threaded program
+                fcntl(values.descriptor(), F_SETFD, 0);
+                fcntl(sockets[1], F_SETFD, 0);
+                char* argv[7] = { const_cast<char*>("reduction_worker") };
+                for (int j=0; j<5; ++j) {
+                    argv[j+1] = const_cast<char*>(arguments[j].c_str());
+                }
+                argv[6] = NULL;
+                execv("/proc/self/exe", argv);
+                _exit(127);
+            }
+            close(sockets[1]);
+            if (pid < 0) {
+                close(sockets[0]);
+                stop();
+                throw std::runtime_error("Could not start a worker");
+            }
+            pids.push_back(pid);
+            connections.push_back(sockets[0]);
+        }
+    }
+
+    /**
+      * Closing the sockets tells the workers to exit
+      */
+    ~process_group() {
+        stop();
+    }
+
+    int size() const {
+        return static_cast<int>(pids.size());
+    }
+
+    /**
+      * Sums the whole shared array with the workers
+      */
+    template <class Algorithm>
+    T reduce() {
+        const size_t n = values.size();
+        const size_t num_blocks = (n + pairwise_block_size - 1) / pairwise_block_size;
+        const size_t workers = connections.size();
+        for (size_t i=0; i<workers; ++i) {
+            detail::worker_request request;
+            request.algorithm = detail::algorithm_id<Algorithm>::value;
+            request.begin = std::min(n, (i*num_blocks/workers)*pairwise_block_size);
+            request.end = std::min(n, ((i+1)*num_blocks/workers)*pairwise_block_size);
+            if (!detail::write_all(connections[i], &request, sizeof(request))) {
+                throw std::runtime_error("Could not send a request to a worker");
+            }
+        }
+
+        pairwise_tree<T> tree;
+        compensated<T> sum;
+        exact_accumulator exact_sum;
+        for (size_t i=0; i<workers; ++i) {
+            uint64_t bytes = 0;
+            std::vector<unsigned char> partial;
+            if (detail::read_all(connections[i], &bytes, sizeof(bytes))) {
+                partial.resize(bytes);
+            }
+            if (partial.size() != bytes || !detail::read_all(connections[i], partial.data(), bytes)) {
+                throw std::runtime_error("Lost the connection to a worker");
+            }
+
+            if constexpr (detail::is_blocked<Algorithm>::value) {
+                for (size_t j=0; j<bytes/sizeof(T); ++j) {
+                    T block_result;
+                    memcpy(&block_result, partial.data() + j*sizeof(T), sizeof(T));
+                    tree.add(block_result);
+                }
+            }
+            else if constexpr (std::is_same<Algorithm, exact>::value) {
+                exact_accumulator worker_sum;
+                if (worker_sum.deserialize(partial.data(), bytes) != bytes) {
+                    throw std::runtime_error("Invalid exact sum from a worker");
+                }
+                exact_sum.add(worker_sum);
+            }
+            else if constexpr (std::is_same<Algorithm, naive>::value) {
+                T worker_sum;
+                memcpy(&worker_sum, partial.data(), sizeof(T));
+                sum.sum += worker_sum;
+            }
+            else {
+                compensated<T> worker_sum;
+                memcpy(&worker_sum, partial.data(), sizeof(worker_sum));
+                sum = two_sum(sum, worker_sum);
+            }
+        }
+
+        if constexpr (detail::is_blocked<Algorithm>::value) {
+            return tree.result();
+        }
+        else if constexpr (std::is_same<Algorithm, exact>::value) {
+            return exact_sum.template result<T>();
+        }
+        else if constexpr (std::is_same<Algorithm, naive>::value) {
+            return sum.sum;
+        }
+        else {
+            return sum.value();
+        }
+    }
+
+private:
+    process_group(const process_group&);
+    process_group& operator=(const process_group&);
+
+    void stop() {
+        for (size_t i=0; i<connections.size(); ++i) {
+            close(connections[i]);
+        }
+        for (size_t i=0; i<pids.size(); ++i) {
+            waitpid(pids[i], NULL, 0);
+        }
+        connections.clear();
+        pids.clear();
+    }
+
+    const shared_array<T>& values;
+    std::vector<pid_t> pids;
+    std::vector<int> connections;
+};
+
+/**
+  * If this process was started by a process_group, serves its requests
+  * until the coordinator goes away and returns true. Otherwise returns
+  * false at once. T must be the same as for the process_group.
+  */
+template <typename T>
+bool serve_if_worker(int argc_, char** argv_) {
+    if (argc_ != 6 || strcmp(argv_[1], detail::worker_flag) != 0) {
+        return false;
+    }
+    const int data = atoi(argv_[2]);
+    const size_t n = strtoull(argv_[3], NULL, 10);
+    const int socket = atoi(argv_[4]);
+    const int threads = atoi(argv_[5]);
+    if (threads > 0) {
+        omp_set_num_threads(threads);
+    }
+
+    const T* values = NULL;
+    if (n > 0) {
+        void* memory = mmap(NULL, n*sizeof(T), PROT_READ, MAP_SHARED, data, 0);
+        if (memory == MAP_FAILED) {
+            return true;
+        }
+        values = static_cast<const T*>(memory);
+    }
+    close(data);
+
+    detail::worker_request request;
+    while (detail::read_all(socket, &request, sizeof(request))) {
+        if (request.begin > request.end || request.end > n) {
+            break;
+        }
+        const T* first = values + request.begin;
+        const T* last = values + request.end;
+        std::vector<unsigned char> partial;
+        switch (request.algorithm) {
+        case detail::algorithm_id<naive>::value: partial = detail::worker_partial<naive>(first, last); break;
+        case detail::algorithm_id<pairwise>::value: partial = detail::worker_partial<pairwise>(first, last); break;
+        case detail::algorithm_id<kahan>::value: partial = detail::worker_partial<kahan>(first, last); break;
+        case detail::algorithm_id<cascade>::value: partial = detail::worker_partial<cascade>(first, last); break;
+        case detail::algorithm_id<neumaier>::value: partial = detail::worker_partial<neumaier>(first, last); break;
+        default: partial = detail::worker_partial<exact>(first, last); break;
+        }
+        const uint64_t bytes = partial.size();
+        if (!detail::write_all(socket, &bytes, sizeof(bytes)) || !detail::write_all(socket, partial.data(), partial.size())) {
+            break;
+        }
+    }
+
+    if (values != NULL) {
+        munmap(const_cast<T*>(values), n*sizeof(T));
+    }
+    close(socket);
+    return true;
+}
+
+} //namespace reduction
+
+#endif
@@ -0,0 +1,646 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef DOUBLE_DOUBLE_H_
+#define DOUBLE_DOUBLE_H_
+
+#include <iostream>
+#include <string>
+#include <cmath>
+
+/**
+  * Double-double (about 106 bit) and quad-double (about 212 bit)
+  * arithmetic, where a number is the unevaluated sum of two or four
+  * doubles of decreasing magnitude. The algorithms follow the QD library
+  * by Hida, Li and Bailey, and only use hardware double arithmetic, which
+  * makes them much faster than the soft-float __float128.
+  */
+namespace multi_double {
+
+/**
+  * Returns a+b, and the exact rounding error in err_
+  */
+inline double two_sum(double a_, double b_, double& err_) {
+    double s = a_ + b_;
+    double bb = s - a_;
+    err_ = (a_ - (s - bb)) + (b_ - bb);
+    return s;
+}
+
+/**
+  * Like two_sum, but requires |a_| >= |b_|
+  */
+inline double quick_two_sum(double a_, double b_, double& err_) {
+    double s = a_ + b_;
+    err_ = b_ - (s - a_);
+    return s;
+}
+
+/**
+  * Splits a_ into two halves of 26 bits for Dekker's product, with
+  * scaling of large values so that the splitting cannot overflow
+  */
+inline void split(double a_, double& hi_, double& lo_) {
+    const double splitter = 134217729.0; //2^27+1
+    const double threshold = 6.69692879491417e+299; //2^996
+    if (a_ > threshold || a_ < -threshold) {
+        a_ *= 3.7252902984619140625e-09; //2^-28
+        double t = splitter*a_;
+        hi_ = t - (t - a_);
+        lo_ = a_ - hi_;
+        hi_ *= 268435456.0; //2^28
+        lo_ *= 268435456.0;
+    }
+    else {
+        double t = splitter*a_;
+        hi_ = t - (t - a_);
+        lo_ = a_ - hi_;
+    }
+}
+
+/**
+  * Returns a*b, and the exact rounding error in err_. Uses a fused
+  * multiply-add when the target has one, and Dekker's splitting otherwise
+  */
+inline double two_prod(double a_, double b_, double& err_) {
+    double p = a_ * b_;
+#if defined(__FMA__) || defined(FP_FAST_FMA)
+    err_ = std::fma(a_, b_, -p);
+#else
+    double a_hi, a_lo, b_hi, b_lo;
+    split(a_, a_hi, a_lo);
+    split(b_, b_hi, b_lo);
+    err_ = ((a_hi*b_hi - p) + a_hi*b_lo + a_lo*b_hi) + a_lo*b_lo;
+#endif
+    return p;
+}
+
+inline void three_sum(double& a_, double& b_, double& c_) {
+    double t1, t2, t3;
+    t1 = two_sum(a_, b_, t2);
+    a_ = two_sum(c_, t1, t3);
+    b_ = two_sum(t2, t3, c_);
+}
+
+inline void three_sum2(double& a_, double& b_, double& c_) {
+    double t1, t2, t3;
+    t1 = two_sum(a_, b_, t2);
+    a_ = two_sum(c_, t1, t3);
+    b_ = t2 + t3;
+}
+
+inline void renormalize(double& c0_, double& c1_, double& c2_, double& c3_) {
+    double s0, s1, s2 = 0.0, s3 = 0.0;
+    if (std::isinf(c0_)) {
+        return;
+    }
+    s0 = quick_two_sum(c2_, c3_, c3_);
+    s0 = quick_two_sum(c1_, s0, c2_);
+    c0_ = quick_two_sum(c0_, s0, c1_);
+
+    s0 = c0_;
+    s1 = c1_;
+    if (s1 != 0.0) {
+        s1 = quick_two_sum(s1, c2_, s2);
+        if (s2 != 0.0) {
+            s2 = quick_two_sum(s2, c3_, s3);
+        }
+        else {
+            s1 = quick_two_sum(s1, c3_, s2);
+        }
+    }
+    else {
+        s0 = quick_two_sum(s0, c2_, s1);
+        if (s1 != 0.0) {
+            s1 = quick_two_sum(s1, c3_, s2);
+        }
+        else {
+            s0 = quick_two_sum(s0, c3_, s1);
+        }
+    }
+    c0_ = s0;
+    c1_ = s1;
+    c2_ = s2;
+    c3_ = s3;
+}
+
+inline void renormalize(double& c0_, double& c1_, double& c2_, double& c3_, double& c4_) {
+    double s0, s1, s2 = 0.0, s3 = 0.0;
+    if (std::isinf(c0_)) {
+        return;
+    }
+    s0 = quick_two_sum(c3_, c4_, c4_);
+    s0 = quick_two_sum(c2_, s0, c3_);
+    s0 = quick_two_sum(c1_, s0, c2_);
+    c0_ = quick_two_sum(c0_, s0, c1_);
+
+    s0 = c0_;
+    s1 = c1_;
+    if (s1 != 0.0) {
+        s1 = quick_two_sum(s1, c2_, s2);
+        if (s2 != 0.0) {
+            s2 = quick_two_sum(s2, c3_, s3);
+            if (s3 != 0.0) {
+                s3 += c4_;
+            }
+            else {
+                s2 += c4_;
+            }
+        }
+        else {
+            s1 = quick_two_sum(s1, c3_, s2);
+            if (s2 != 0.0) {
+                s2 = quick_two_sum(s2, c4_, s3);
+            }
+            else {
+                s1 = quick_two_sum(s1, c4_, s2);
+            }
+        }
+    }
+    else {
+        s0 = quick_two_sum(s0, c2_, s1);
+        if (s1 != 0.0) {
+            s1 = quick_two_sum(s1, c3_, s2);
+            if (s2 != 0.0) {
+                s2 = quick_two_sum(s2, c4_, s3);
+            }
+            else {
+                s1 = quick_two_sum(s1, c4_, s2);
+            }
+        }
+        else {
+            s0 = quick_two_sum(s0, c3_, s1);
+            if (s1 != 0.0) {
+                s1 = quick_two_sum(s1, c4_, s2);
+            }
+            else {
+                s0 = quick_two_sum(s0, c4_, s1);
+            }
+        }
+    }
+    c0_ = s0;
+    c1_ = s1;
+    c2_ = s2;
+    c3_ = s3;
+}
+
+} //namespace multi_double
+
+/**
+  * Double-double number hi + lo, with |lo| <= ulp(hi)/2
+  */
+struct double_double {
+    double hi;
+    double lo;
+
+    double_double() : hi(0.0), lo(0.0) {}
+    double_double(double hi_) : hi(hi_), lo(0.0) {}
+    double_double(double hi_, double lo_) : hi(hi_), lo(lo_) {}
+
+    double to_double() const {
+        return hi + lo;
+    }
+
+    double leading() const {
+        return hi;
+    }
+
+    double_double operator-() const {
+        return double_double(-hi, -lo);
+    }
+
+    double_double& operator+=(const double_double& b_);
+    double_double& operator-=(const double_double& b_);
+    double_double& operator*=(const double_double& b_);
+    double_double& operator/=(const double_double& b_);
+};
+
+/**
+  * Accurate double-double addition (QD's ieee_add), with the error
+  * bounded relative to |a + b| even under heavy cancellation
+  */
+inline double_double accurate_add(const double_double& a_, const double_double& b_) {
+    using namespace multi_double;
+    double s2, t2;
+    double s1 = two_sum(a_.hi, b_.hi, s2);
+    double t1 = two_sum(a_.lo, b_.lo, t2);
+    s2 += t1;
+    s1 = quick_two_sum(s1, s2, s2);
+    s2 += t2;
+    s1 = quick_two_sum(s1, s2, s2);
+    return double_double(s1, s2);
+}
+
+/**
+  * Fast double-double addition (QD's default sloppy_add), with the error
+  * bounded relative to |a| + |b|, which is what the error bound of a
+  * summation depends on anyway
+  */
+inline double_double operator+(const double_double& a_, const double_double& b_) {
+    using namespace multi_double;
+    double e;
+    double s = two_sum(a_.hi, b_.hi, e);
+    e += (a_.lo + b_.lo);
+    s = quick_two_sum(s, e, e);
+    return double_double(s, e);
+}
+
+inline double_double operator+(const double_double& a_, double b_) {
+    using namespace multi_double;
+    double s2;
+    double s1 = two_sum(a_.hi, b_, s2);
+    s2 += a_.lo;
+    s1 = quick_two_sum(s1, s2, s2);
+    return double_double(s1, s2);
+}
+
+inline double_double operator-(const double_double& a_, const double_double& b_) {
+    return a_ + (-b_);
+}
+
+inline double_double operator*(const double_double& a_, const double_double& b_) {
+    using namespace multi_double;
+    double p2;
+    double p1 = two_prod(a_.hi, b_.hi, p2);
+    p2 += (a_.hi*b_.lo + a_.lo*b_.hi);
+    p1 = quick_two_sum(p1, p2, p2);
+    return double_double(p1, p2);
+}
+
+inline double_double operator*(const double_double& a_, double b_) {
+    using namespace multi_double;
+    double p2;
+    double p1 = two_prod(a_.hi, b_, p2);
+    p2 += a_.lo*b_;
+    p1 = quick_two_sum(p1, p2, p2);
+    return double_double(p1, p2);
+}
+
+inline double_double operator/(const double_double& a_, const double_double& b_) {
+    using namespace multi_double;
+    double q1 = a_.hi / b_.hi;
+    double_double r = a_ - b_*q1;
+    double q2 = r.hi / b_.hi;
+    r -= b_*q2;
+    double q3 = r.hi / b_.hi;
+    q1 = quick_two_sum(q1, q2, q2);
+    return double_double(q1, q2) + q3;
+}
+
+inline double_double& double_double::operator+=(const double_double& b_) { return *this = *this + b_; }
+inline double_double& double_double::operator-=(const double_double& b_) { return *this = *this - b_; }
+inline double_double& double_double::operator*=(const double_double& b_) { return *this = *this * b_; }
+inline double_double& double_double::operator/=(const double_double& b_) { return *this = *this / b_; }
+
+/**
+  * Quad-double number x[0] + x[1] + x[2] + x[3]
+  */
+struct quad_double {
+    double x[4];
+
+    quad_double() { x[0] = x[1] = x[2] = x[3] = 0.0; }
+    quad_double(double x0_) { x[0] = x0_; x[1] = x[2] = x[3] = 0.0; }
+    quad_double(double x0_, double x1_, double x2_, double x3_) { x[0] = x0_; x[1] = x1_; x[2] = x2_; x[3] = x3_; }
+
+    double to_double() const {
+        return x[0] + x[1] + x[2] + x[3];
+    }
+
+    double leading() const {
+        return x[0];
+    }
+
+    quad_double operator-() const {
+        return quad_double(-x[0], -x[1], -x[2], -x[3]);
+    }
+
+    quad_double& operator+=(const quad_double& b_);
+    quad_double& operator-=(const quad_double& b_);
+    quad_double& operator*=(const quad_double& b_);
+    quad_double& operator/=(const quad_double& b_);
+};
+
+namespace multi_double {
+
+/**
+  * Adds c_ to the double-length accumulator (a_, b_), and returns
+  * the part that no longer fits (or zero)
+  */
+inline double quick_three_accumulate(double& a_, double& b_, double c_) {
+    double s = two_sum(b_, c_, b_);
+    s = two_sum(a_, s, a_);
+    const bool za = (a_ != 0.0);
+    const bool zb = (b_ != 0.0);
+    if (za && zb) {
+        return s;
+    }
+    if (!zb) {
+        b_ = a_;
+        a_ = s;
+    }
+    else {
+        a_ = s;
+    }
+    return 0.0;
+}
+
+} //namespace multi_double
+
+/**
+  * Accurate quad-double addition, which merges the components of the
+  * two operands by decreasing magnitude (QD's ieee_add). The error is
+  * bounded relative to |a + b|, even under heavy cancellation.
+  */
+inline quad_double accurate_add(const quad_double& a_, const quad_double& b_) {
+    using namespace multi_double;
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    double u, v, t;
+    double x[4] = {0.0, 0.0, 0.0, 0.0};
+
+    u = (std::abs(a_.x[i]) > std::abs(b_.x[j])) ? a_.x[i++] : b_.x[j++];
+    v = (std::abs(a_.x[i]) > std::abs(b_.x[j])) ? a_.x[i++] : b_.x[j++];
+    u = quick_two_sum(u, v, v);
+
+    while (k < 4) {
+        if (i >= 4 && j >= 4) {
+            x[k] = u;
+            if (k < 3) {
+                x[++k] = v;
+            }
+            break;
+        }
+
+        if (i >= 4) {
+            t = b_.x[j++];
+        }
+        else if (j >= 4) {
+            t = a_.x[i++];
+        }
+        else if (std::abs(a_.x[i]) > std::abs(b_.x[j])) {
+            t = a_.x[i++];
+        }
+        else {
+            t = b_.x[j++];
+        }
+
+        double s = quick_three_accumulate(u, v, t);
+        if (s != 0.0) {
+            x[k++] = s;
+        }
+    }
+
+    for (k = i; k < 4; ++k) {
+        x[3] += a_.x[k];
+    }
+    for (k = j; k < 4; ++k) {
+        x[3] += b_.x[k];
+    }
+    renormalize(x[0], x[1], x[2], x[3]);
+    return quad_double(x[0], x[1], x[2], x[3]);
+}
+
+/**
+  * Fast quad-double addition (QD's default sloppy_add), where the error
+  * is bounded relative to |a| + |b|. This is what the error bound of a
+  * summation depends on anyway, and it has no data dependent branches.
+  */
+inline quad_double operator+(const quad_double& a_, const quad_double& b_) {
+    using namespace multi_double;
+    double t0, t1, t2, t3;
+    double s0 = two_sum(a_.x[0], b_.x[0], t0);
+    double s1 = two_sum(a_.x[1], b_.x[1], t1);
+    double s2 = two_sum(a_.x[2], b_.x[2], t2);
+    double s3 = two_sum(a_.x[3], b_.x[3], t3);
+
+    s1 = two_sum(s1, t0, t0);
+    three_sum(s2, t0, t1);
+    three_sum2(s3, t0, t2);
+    t0 = t0 + t1 + t3;
+
+    renormalize(s0, s1, s2, s3, t0);
+    return quad_double(s0, s1, s2, s3);
+}
+
+inline quad_double operator+(const quad_double& a_, double b_) {
+    using namespace multi_double;
+    double e;
+    double c0 = two_sum(a_.x[0], b_, e);
+    double c1 = two_sum(a_.x[1], e, e);
+    double c2 = two_sum(a_.x[2], e, e);
+    double c3 = two_sum(a_.x[3], e, e);
+    renormalize(c0, c1, c2, c3, e);
+    return quad_double(c0, c1, c2, c3);
+}
+
+inline quad_double operator-(const quad_double& a_, const quad_double& b_) {
+    return a_ + (-b_);
+}
+
+inline quad_double operator*(const quad_double& a_, double b_) {
+    using namespace multi_double;
+    double q0, q1, q2;
+    double p0 = two_prod(a_.x[0], b_, q0);
+    double p1 = two_prod(a_.x[1], b_, q1);
+    double p2 = two_prod(a_.x[2], b_, q2);
+    double p3 = a_.x[3] * b_;
+
+    double s0 = p0;
+    double s2;
+    double s1 = two_sum(q0, p1, s2);
+    three_sum(s2, q1, p2);
+    three_sum2(q1, q2, p3);
+    double s3 = q1;
+    double s4 = q2 + p2;
+    renormalize(s0, s1, s2, s3, s4);
+    return quad_double(s0, s1, s2, s3);
+}
+
+inline quad_double operator*(const quad_double& a_, const quad_double& b_) {
+    using namespace multi_double;
+    double q0, q1, q2, q3, q4, q5;
+    double t0, t1;
+
+    double p0 = two_prod(a_.x[0], b_.x[0], q0);
+    double p1 = two_prod(a_.x[0], b_.x[1], q1);
+    double p2 = two_prod(a_.x[1], b_.x[0], q2);
+    double p3 = two_prod(a_.x[0], b_.x[2], q3);
+    double p4 = two_prod(a_.x[1], b_.x[1], q4);
+    double p5 = two_prod(a_.x[2], b_.x[0], q5);
+
+    three_sum(p1, p2, q0);
+
+    //Six-three sum of p2, q1, q2, p3, p4, p5
+    three_sum(p2, q1, q2);
+    three_sum(p3, p4, p5);
+    double s0 = two_sum(p2, p3, t0);
+    double s1 = two_sum(q1, p4, t1);
+    double s2 = q2 + p5;
+    s1 = two_sum(s1, t0, t0);
+    s2 += (t0 + t1);
+
+    //Terms of order eps^3
+    s1 += a_.x[0]*b_.x[3] + a_.x[1]*b_.x[2] + a_.x[2]*b_.x[1] + a_.x[3]*b_.x[0] + q0 + q3 + q4 + q5;
+    renormalize(p0, p1, s0, s1, s2);
+    return quad_double(p0, p1, s0, s1);
+}
+
+inline quad_double operator/(const quad_double& a_, const quad_double& b_) {
+    using namespace multi_double;
+    double q0 = a_.x[0] / b_.x[0];
+    quad_double r = a_ - b_*q0;
+    double q1 = r.x[0] / b_.x[0];
+    r -= b_*q1;
+    double q2 = r.x[0] / b_.x[0];
+    r -= b_*q2;
+    double q3 = r.x[0] / b_.x[0];
+    renormalize(q0, q1, q2, q3);
+    return quad_double(q0, q1, q2, q3);
+}
+
+inline quad_double& quad_double::operator+=(const quad_double& b_) { return *this = *this + b_; }
+inline quad_double& quad_double::operator-=(const quad_double& b_) { return *this = *this - b_; }
+inline quad_double& quad_double::operator*=(const quad_double& b_) { return *this = *this * b_; }
+inline quad_double& quad_double::operator/=(const quad_double& b_) { return *this = *this / b_; }
+
+namespace multi_double {
+
+/**
+  * Writes x_ in decimal, honouring std::fixed and the precision of the
+  * stream (scientific notation otherwise). The digits are generated by
+  * repeatedly multiplying the remainder by ten in the extended precision.
+  */
+template <class R>
+void write_decimal(std::ostream& out_, R x_) {
+    const double leading = x_.leading();
+    if (std::isnan(leading) || std::isinf(leading)) {
+        out_ << leading;
+        return;
+    }
+
+    std::string text;
+    if (leading < 0.0 || (leading == 0.0 && std::signbit(leading))) {
+        text += '-';
+        x_ = -x_;
+    }
+
+    //Scale x_ into [1, 10)
+    int exponent = (x_.leading() == 0.0) ? 0 : static_cast<int>(std::floor(std::log10(x_.leading())));
+    R scale = 1.0;
+    for (int i=0; i<std::abs(exponent); ++i) {
+        scale = scale*10.0;
+    }
+    x_ = (exponent >= 0) ? x_ / scale : x_ * scale;
+    if ((x_ - R(10.0)).leading() >= 0.0) {
+        x_ = x_ / R(10.0);
+        ++exponent;
+    }
+    else if (x_.leading() != 0.0 && (x_ - R(1.0)).leading() < 0.0) {
+        x_ = x_ * 10.0;
+        --exponent;
+    }
+
+    const bool fixed = (out_.flags() & std::ios_base::floatfield) == std::ios_base::fixed;
+    const int precision = static_cast<int>(out_.precision());
+    const int digits = fixed ? exponent + 1 + precision : precision + 1;
+    if (digits < 0) {
+        //Too small to show up in the requested number of decimals
+        out_ << text << "0" << ((precision > 0) ? "." + std::string(precision, '0') : "");
+        return;
+    }
+    std::string mantissa;
+    for (int i=0; i<digits+1; ++i) {
+        double digit = std::floor(x_.leading());
+        R remainder = x_ - R(digit);
+        if (remainder.leading() < 0.0) {
+            digit -= 1.0;
+            remainder = x_ - R(digit);
+        }
+        mantissa += static_cast<char>('0' + static_cast<int>(digit));
+        x_ = remainder * 10.0;
+    }
+
+    //Round to nearest using the extra digit
+    const bool round_up = (mantissa[mantissa.size()-1] >= '5');
+    mantissa.erase(mantissa.size()-1);
+    if (round_up) {
+        int i = static_cast<int>(mantissa.size()) - 1;
+        for (; i >= 0 && mantissa[i] == '9'; --i) {
+            mantissa[i] = '0';
+        }
+        if (i >= 0) {
+            ++mantissa[i];
+        }
+        else {
+            mantissa.insert(0, "1");
+            ++exponent;
+            if (!fixed) {
+                mantissa.erase(mantissa.size()-1);
+            }
+        }
+    }
+
+    if (fixed) {
+        if (exponent < 0) {
+            mantissa = std::string(-exponent, '0') + mantissa;
+            exponent = 0;
+        }
+        text += mantissa.substr(0, exponent+1);
+        if (precision > 0) {
+            text += "." + mantissa.substr(exponent+1);
+        }
+    }
+    else {
+        text += mantissa.substr(0, 1);
+        if (precision > 0) {
+            text += "." + mantissa.substr(1);
+        }
+        text += (exponent < 0) ? "e-" : "e+";
+        if (std::abs(exponent) < 10) {
+            text += '0';
+        }
+        text += std::to_string(std::abs(exponent));
+    }
+    out_ << text;
+}
+
+} //namespace multi_double
+
+inline std::ostream& operator<<(std::ostream& out_, const double_double& x_) {
+    multi_double::write_decimal(out_, x_);
+    return out_;
+}
+
+inline std::ostream& operator<<(std::ostream& out_, const quad_double& x_) {
+    multi_double::write_decimal(out_, x_);
+    return out_;
+}
+
+#endif
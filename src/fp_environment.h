@@ -0,0 +1,116 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef FP_ENVIRONMENT_H_
+#define FP_ENVIRONMENT_H_
+
+#include <vector>
+#include <omp.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FP_ENVIRONMENT_MXCSR 1
+#include <xmmintrin.h>
+#endif
+
+/**
+  * Returns true if the SSE control register (MXCSR) is available, so
+  * that flush_denormals_scope has an effect. x87 arithmetic (e.g., long
+  * double) is never affected.
+  */
+inline bool flush_denormals_supported() {
+#ifdef FP_ENVIRONMENT_MXCSR
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+  * Returns true if the calling thread flushes denormals
+  */
+inline bool denormals_flushed() {
+#ifdef FP_ENVIRONMENT_MXCSR
+    const unsigned int flags = 0x8040;
+    return (_mm_getcsr() & flags) == flags;
+#else
+    return false;
+#endif
+}
+
+/**
+  * Turns on flush-to-zero (subnormal results become zero) and
+  * denormals-are-zero (subnormal inputs are read as zero) on every OpenMP
+  * thread, including the calling thread which is thread 0 of the team, and
+  * restores the previous modes when it goes out of scope. This avoids the
+  * microcode assists that make subnormal arithmetic slow, at the cost of
+  * losing everything below the smallest normal number. The MXCSR register
+  * is per thread, so the scope must be created outside of parallel regions,
+  * and the number of OpenMP threads must not change while it is alive.
+  */
+class flush_denormals_scope {
+public:
+    explicit flush_denormals_scope(bool enable_ = true) : enabled(enable_) {
+#ifdef FP_ENVIRONMENT_MXCSR
+        if (!enabled) return;
+        saved.resize(omp_get_max_threads());
+        #pragma omp parallel
+        {
+            const int thread = omp_get_thread_num();
+            if (thread < static_cast<int>(saved.size())) {
+                saved[thread] = _mm_getcsr();
+                _mm_setcsr(saved[thread] | ftz_daz);
+            }
+        }
+#endif
+    }
+
+    ~flush_denormals_scope() {
+#ifdef FP_ENVIRONMENT_MXCSR
+        if (!enabled) return;
+        #pragma omp parallel
+        {
+            const int thread = omp_get_thread_num();
+            if (thread < static_cast<int>(saved.size())) {
+                _mm_setcsr(saved[thread]);
+            }
+        }
+#endif
+    }
+
+private:
+    flush_denormals_scope(const flush_denormals_scope&);
+    flush_denormals_scope& operator=(const flush_denormals_scope&);
+
+    static const unsigned int ftz_daz = 0x8040; //Bit 15 flush-to-zero, bit 6 denormals-are-zero
+
+    bool enabled;
+    std::vector<unsigned int> saved;
+};
+
+#endif
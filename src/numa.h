@@ -0,0 +1,261 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef NUMA_H_
+#define NUMA_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <new>
+#include <vector>
+#include <string>
+#include <omp.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+/**
+  * Splits n_ elements into num_parts_ contiguous parts of (almost) equal
+  * size. The reductions and the first-touch initialization use the same
+  * partitioning, so that each thread reads memory on its own NUMA node.
+  */
+inline void static_partition(size_t n_, size_t part_, size_t num_parts_, size_t& begin_, size_t& end_) {
+    begin_ = n_*part_/num_parts_;
+    end_ = n_*(part_+1)/num_parts_;
+}
+
+/**
+  * Parallel first-touch is on by default, and can be turned off
+  * by setting the environment variable NUMA_FIRST_TOUCH=0
+  */
+inline bool numa_first_touch_enabled() {
+    static const char* setting = getenv("NUMA_FIRST_TOUCH");
+    static const bool enabled = (setting == NULL || strcmp(setting, "0") != 0);
+    return enabled;
+}
+
+/**
+  * Allocator which places memory where it will be used: The operating
+  * system maps each page on the NUMA node of the thread that first writes
+  * to it, so every OpenMP thread zeroes its own static partition of a new
+  * allocation. Default construction leaves elements uninitialized, so that
+  * a serial initialization afterwards does not change the placement.
+  */
+template <typename T>
+class first_touch_allocator {
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef first_touch_allocator<U> other;
+    };
+
+    first_touch_allocator() {}
+
+    template <typename U>
+    first_touch_allocator(const first_touch_allocator<U>&) {}
+
+    T* allocate(size_t n_) {
+        const size_t page_size = 4096;
+        const size_t bytes = n_*sizeof(T);
+#ifdef _WIN32
+        void* data = _aligned_malloc(bytes, page_size);
+#else
+        void* data = NULL;
+        if (posix_memalign(&data, page_size, bytes) != 0) {
+            data = NULL;
+        }
+#endif
+        if (data == NULL) {
+            throw std::bad_alloc();
+        }
+
+        if (numa_first_touch_enabled()) {
+            char* buffer = static_cast<char*>(data);
+            #pragma omp parallel
+            {
+                size_t begin, end;
+                static_partition(n_, omp_get_thread_num(), omp_get_num_threads(), begin, end);
+                memset(buffer + begin*sizeof(T), 0, (end-begin)*sizeof(T));
+            }
+        }
+        return static_cast<T*>(data);
+    }
+
+    void deallocate(T* data_, size_t) {
+#ifdef _WIN32
+        _aligned_free(data_);
+#else
+        free(data_);
+#endif
+    }
+
+    template <typename U>
+    void construct(U* data_) {
+        ::new (static_cast<void*>(data_)) U;
+    }
+
+    template <typename U>
+    void construct(U* data_, const U& value_) {
+        ::new (static_cast<void*>(data_)) U(value_);
+    }
+
+    template <typename U>
+    void destroy(U* data_) {
+        data_->~U();
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const first_touch_allocator<T>&, const first_touch_allocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const first_touch_allocator<T>&, const first_touch_allocator<U>&) {
+    return false;
+}
+
+/**
+  * Returns the CPU the calling thread runs on, or -1 if unknown
+  */
+inline int current_cpu() {
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+/**
+  * Returns the socket (physical package) of a CPU, or 0 if unknown
+  */
+inline int socket_of_cpu(int cpu_) {
+    int socket = 0;
+#ifdef __linux__
+    char filename[128];
+    snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu_);
+    FILE* file = fopen(filename, "r");
+    if (file != NULL) {
+        if (fscanf(file, "%d", &socket) != 1) {
+            socket = 0;
+        }
+        fclose(file);
+    }
+#endif
+    return (socket < 0) ? 0 : socket;
+}
+
+#if defined(_OPENMP) && _OPENMP >= 201307
+inline const char* proc_bind_name(omp_proc_bind_t bind_) {
+    switch (bind_) {
+    case omp_proc_bind_false: return "false";
+    case omp_proc_bind_true: return "true";
+    case omp_proc_bind_master: return "master";
+    case omp_proc_bind_close: return "close";
+    case omp_proc_bind_spread: return "spread";
+    default: return "unknown";
+    }
+}
+#endif
+
+/**
+  * Pins the OpenMP threads to CPUs when PIN_THREADS=close (fill one socket
+  * first) or PIN_THREADS=spread (round robin over the sockets) is set. If
+  * the OpenMP runtime already binds threads through OMP_PROC_BIND, that
+  * binding is kept. Returns the policy in effect.
+  */
+inline std::string pin_threads() {
+#if defined(_OPENMP) && _OPENMP >= 201307
+    if (omp_get_proc_bind() != omp_proc_bind_false) {
+        return std::string("OMP_PROC_BIND=") + proc_bind_name(omp_get_proc_bind());
+    }
+#else
+    //Runtimes before OpenMP 4.0 (e.g., MSVC) cannot be asked, so trust the environment
+    const char* bind = getenv("OMP_PROC_BIND");
+    if (bind != NULL && strcmp(bind, "false") != 0 && strcmp(bind, "FALSE") != 0) {
+        return std::string("OMP_PROC_BIND=") + bind;
+    }
+#endif
+    const char* setting = getenv("PIN_THREADS");
+    if (setting == NULL || (strcmp(setting, "close") != 0 && strcmp(setting, "spread") != 0)) {
+        return "none";
+    }
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return "none";
+    }
+
+    //Allowed CPUs grouped by socket
+    std::vector<std::vector<int> > sockets;
+    for (int cpu=0; cpu<CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            const size_t socket = socket_of_cpu(cpu);
+            if (socket >= sockets.size()) {
+                sockets.resize(socket+1);
+            }
+            sockets[socket].push_back(cpu);
+        }
+    }
+    std::vector<int> order;
+    if (strcmp(setting, "close") == 0) {
+        for (size_t i=0; i<sockets.size(); ++i) {
+            order.insert(order.end(), sockets[i].begin(), sockets[i].end());
+        }
+    }
+    else {
+        for (size_t j=0; order.size() < static_cast<size_t>(CPU_COUNT(&allowed)); ++j) {
+            for (size_t i=0; i<sockets.size(); ++i) {
+                if (j < sockets[i].size()) {
+                    order.push_back(sockets[i][j]);
+                }
+            }
+        }
+    }
+
+    #pragma omp parallel
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(order[omp_get_thread_num() % order.size()], &cpus);
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+    }
+    return std::string("PIN_THREADS=") + setting;
+#else
+    return "none";
+#endif
+}
+
+#endif
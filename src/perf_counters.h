@@ -0,0 +1,273 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <omp.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+  * Hardware events counted around the kernels
+  */
+enum perf_event_id {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_FP_ASSISTS,
+    PERF_DTLB_MISSES,
+    PERF_NUM_EVENTS
+};
+
+/**
+  * Counter values, where -1 means that the event could not be counted
+  */
+struct perf_values {
+    long long value[PERF_NUM_EVENTS];
+
+    perf_values() {
+        for (int i=0; i<PERF_NUM_EVENTS; ++i) {
+            value[i] = -1;
+        }
+    }
+
+    bool has(perf_event_id event_) const {
+        return value[event_] >= 0;
+    }
+
+    /**
+      * Adds the counts of another thread. An event is only valid
+      * if it was counted on all threads.
+      */
+    void add(const perf_values& other_) {
+        for (int i=0; i<PERF_NUM_EVENTS; ++i) {
+            value[i] = (value[i] < 0 || other_.value[i] < 0) ? -1 : value[i] + other_.value[i];
+        }
+    }
+};
+
+/**
+  * Counters of the calling thread (only user space is counted, so that
+  * this works with the default perf_event_paranoid setting). Events the
+  * CPU or kernel do not support are left unavailable. FP assists (e.g.,
+  * for denormals) are a model specific raw event which defaults to
+  * FP_ASSIST.ANY on Intel, and can be changed with PERF_FP_ASSIST_EVENT.
+  */
+class perf_counters {
+public:
+    perf_counters() {
+        for (int i=0; i<PERF_NUM_EVENTS; ++i) {
+            fd[i] = -1;
+        }
+#ifdef __linux__
+        const unsigned long long cache_read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const char* fp_assist_event = getenv("PERF_FP_ASSIST_EVENT");
+        fd[PERF_CYCLES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        fd[PERF_INSTRUCTIONS] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        fd[PERF_L1D_MISSES] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cache_read_miss);
+        fd[PERF_LLC_MISSES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        fd[PERF_FP_ASSISTS] = open(PERF_TYPE_RAW, (fp_assist_event != NULL) ? strtoull(fp_assist_event, NULL, 0) : 0x1eca);
+        fd[PERF_DTLB_MISSES] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | cache_read_miss);
+#endif
+    }
+
+    ~perf_counters() {
+#ifdef __linux__
+        for (int i=0; i<PERF_NUM_EVENTS; ++i) {
+            if (fd[i] >= 0) {
+                close(fd[i]);
+            }
+        }
+#endif
+    }
+
+    bool available() const {
+        return fd[PERF_CYCLES] >= 0;
+    }
+
+    void start() {
+#ifdef __linux__
+        for (int i=0; i<PERF_NUM_EVENTS; ++i) {
+            if (fd[i] >= 0) {
+                ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        for (int i=0; i<PERF_NUM_EVENTS; ++i) {
+            if (fd[i] >= 0) {
+                ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+#endif
+    }
+
+    perf_values read_values() const {
+        perf_values result;
+#ifdef __linux__
+        for (int i=0; i<PERF_NUM_EVENTS; ++i) {
+            long long count;
+            if (fd[i] >= 0 && read(fd[i], &count, sizeof(count)) == sizeof(count)) {
+                result.value[i] = count;
+            }
+        }
+#endif
+        return result;
+    }
+
+private:
+    perf_counters(const perf_counters&);
+    perf_counters& operator=(const perf_counters&);
+
+#ifdef __linux__
+    static int open(unsigned int type_, unsigned long long config_) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type_;
+        attr.config = config_;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+#endif
+
+    int fd[PERF_NUM_EVENTS];
+};
+
+/**
+  * Counters of the calling thread, opened on first use
+  */
+inline perf_counters& thread_perf_counters() {
+    static thread_local perf_counters counters;
+    return counters;
+}
+
+/**
+  * Runs function_ once with the counters of each thread enabled, and returns
+  * the sum over the threads. If parallel_ is true, the counters are enabled
+  * on every thread in the OpenMP team (which is reused by the parallel
+  * region of the kernel), otherwise only on the calling thread.
+  */
+template <typename R, class F>
+perf_values measure_perf_counters(bool parallel_, F function_, R& result_) {
+    perf_values total;
+    if (!parallel_) {
+        perf_counters& counters = thread_perf_counters();
+        counters.start();
+        result_ = function_();
+        counters.stop();
+        return counters.read_values();
+    }
+
+    std::vector<perf_values> values(omp_get_max_threads());
+    #pragma omp parallel
+    thread_perf_counters().start();
+
+    result_ = function_();
+
+    #pragma omp parallel
+    {
+        thread_perf_counters().stop();
+        values[omp_get_thread_num()] = thread_perf_counters().read_values();
+    }
+    total = values[0];
+    for (size_t i=1; i<values.size(); ++i) {
+        total.add(values[i]);
+    }
+    return total;
+}
+
+inline bool& perf_counters_warned() {
+    static bool warned = false;
+    return warned;
+}
+
+/**
+  * Prints IPC, bytes per cycle (unless bytes_ is zero) and the cache miss,
+  * FP assist and dTLB miss counts of one run of function_. Without counters
+  * (e.g., no PMU in a virtual machine, or perf_event_paranoid too strict)
+  * this prints a note once, and the timing of the benchmark harness is all
+  * there is.
+  */
+template <typename R, class F>
+void print_perf_counters(size_t bytes_, bool parallel_, F function_, R& result_) {
+    perf_values values = measure_perf_counters(parallel_, function_, result_);
+    if (!values.has(PERF_CYCLES)) {
+        if (!perf_counters_warned()) {
+            std::cout << "`-> perf: hardware counters unavailable, reporting timing only" << std::endl;
+            perf_counters_warned() = true;
+        }
+        return;
+    }
+
+    const double cycles = static_cast<double>(values.value[PERF_CYCLES]);
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(2) << "`-> perf: ";
+    line << static_cast<long long>(cycles) << " cycles";
+    if (values.has(PERF_INSTRUCTIONS)) {
+        line << ", IPC " << values.value[PERF_INSTRUCTIONS] / cycles;
+    }
+    if (bytes_ > 0) {
+        line << ", " << bytes_ / cycles << " bytes/cycle";
+    }
+    if (values.has(PERF_L1D_MISSES)) {
+        line << ", L1D misses " << values.value[PERF_L1D_MISSES];
+    }
+    if (values.has(PERF_LLC_MISSES)) {
+        line << ", LLC misses " << values.value[PERF_LLC_MISSES];
+    }
+    if (values.has(PERF_FP_ASSISTS)) {
+        line << ", FP assists " << values.value[PERF_FP_ASSISTS];
+    }
+    if (values.has(PERF_DTLB_MISSES)) {
+        line << ", dTLB misses " << values.value[PERF_DTLB_MISSES];
+    }
+    std::cout << line.str() << std::endl;
+}
+
+#endif
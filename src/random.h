@@ -0,0 +1,201 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include <omp.h>
+
+#include "compensated_summation.h"
+#include "numa.h"
+
+/**
+  * Distributions of the benchmark input
+  */
+enum random_distribution {
+    RANDOM_UNIFORM,     //Uniform in [0, 1)
+    RANDOM_LOG_UNIFORM, //Mantissa uniform in [1, 2), exponent uniform in [-32, 31]
+    RANDOM_CANCELLATION //Pairs of large values of opposite sign, where the first also has a
+                        //value in [0, 1) added, so the sum is tiny compared to the terms
+};
+
+inline const char* random_distribution_name(random_distribution distribution_) {
+    switch (distribution_) {
+    case RANDOM_LOG_UNIFORM: return "log-uniform";
+    case RANDOM_CANCELLATION: return "cancellation";
+    default: return "uniform";
+    }
+}
+
+/**
+  * Counter-based generator: The bits of element index_ are the SplitMix64
+  * finalizer of the seed and the index, so any element can be computed on
+  * its own. The input is thus the same for any number of threads or any
+  * vector width, and the loops which fill it have no dependencies.
+  */
+inline uint64_t random_bits(uint64_t seed_, uint64_t index_) {
+    uint64_t z = seed_*0xd1b54a32d192ed03ull + (index_+1)*0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+namespace detail {
+
+/**
+  * Uniform in [0, 1): The top bits become the mantissa of a value in
+  * [1, 2), which only needs integer instructions and so vectorizes
+  * without a 64 bit integer to floating point conversion
+  */
+template <typename T>
+inline T random_uniform(uint64_t bits_) {
+    if (sizeof(T) == sizeof(float)) {
+        const uint32_t mantissa = static_cast<uint32_t>(bits_ >> 41) | 0x3f800000u;
+        float result;
+        memcpy(&result, &mantissa, sizeof(result));
+        return static_cast<T>(result - 1.0f);
+    }
+    const uint64_t mantissa = (bits_ >> 12) | 0x3ff0000000000000ull;
+    double result;
+    memcpy(&result, &mantissa, sizeof(result));
+    return static_cast<T>(result - 1.0);
+}
+
+/**
+  * 2^exponent_ for exponents within the normal range of double, built
+  * from the bits instead of with ldexp so that the loops vectorize
+  */
+inline double power_of_two(int64_t exponent_) {
+    const uint64_t bits = static_cast<uint64_t>(exponent_ + 1023) << 52;
+    double result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+} //namespace detail
+
+/**
+  * Element index_ of the input with distribution D and the given seed
+  */
+template <random_distribution D, typename T>
+inline T random_value(uint64_t seed_, uint64_t index_) {
+    if constexpr (D == RANDOM_LOG_UNIFORM) {
+        const uint64_t bits = random_bits(seed_, index_);
+        const double mantissa = 1.0 + detail::random_uniform<double>(bits);
+        return static_cast<T>(mantissa * detail::power_of_two(static_cast<int64_t>(bits & 63) - 32));
+    }
+    else if constexpr (D == RANDOM_CANCELLATION) {
+        //The large value is shared by the pair, and 2^20 to 2^35 times larger than the small one
+        const uint64_t pair_bits = random_bits(seed_, index_ & ~uint64_t(1));
+        const T large = static_cast<T>((1.0 + detail::random_uniform<double>(pair_bits)) 
+            * detail::power_of_two(20 + static_cast<int64_t>(pair_bits & 15)));
+        const T small = detail::random_uniform<T>(random_bits(seed_ + 1, index_));
+        return (index_ & 1) ? -large : large + small;
+    }
+    else {
+        return detail::random_uniform<T>(random_bits(seed_, index_));
+    }
+}
+
+template <typename T>
+inline T random_value(random_distribution distribution_, uint64_t seed_, uint64_t index_) {
+    switch (distribution_) {
+    case RANDOM_LOG_UNIFORM: return random_value<RANDOM_LOG_UNIFORM, T>(seed_, index_);
+    case RANDOM_CANCELLATION: return random_value<RANDOM_CANCELLATION, T>(seed_, index_);
+    default: return random_value<RANDOM_UNIFORM, T>(seed_, index_);
+    }
+}
+
+namespace detail {
+
+template <random_distribution D, typename T>
+inline void fill_random_range(T* values_, size_t begin_, size_t end_, uint64_t seed_) {
+    #pragma omp simd
+    for (size_t i=begin_; i<end_; ++i) {
+        values_[i] = random_value<D, T>(seed_, i);
+    }
+}
+
+#ifdef COMPENSATED_SUMMATION_X86
+//The 64 bit multiplications of the generator need wide vectors to pay off
+template <random_distribution D, typename T>
+SIMD_KERNEL("avx2") void fill_random_avx2(T* values_, size_t begin_, size_t end_, uint64_t seed_) {
+    fill_random_range<D>(values_, begin_, end_, seed_);
+}
+
+template <random_distribution D, typename T>
+SIMD_KERNEL("avx512f") void fill_random_avx512(T* values_, size_t begin_, size_t end_, uint64_t seed_) {
+    fill_random_range<D>(values_, begin_, end_, seed_);
+}
+#endif
+
+template <random_distribution D, typename T>
+void fill_random(T* values_, size_t n_, uint64_t seed_) {
+    #pragma omp parallel
+    {
+        size_t begin, end;
+        static_partition(n_, omp_get_thread_num(), omp_get_num_threads(), begin, end);
+#ifdef COMPENSATED_SUMMATION_X86
+        switch (get_simd_level()) {
+        case SIMD_AVX512: fill_random_avx512<D>(values_, begin, end, seed_); break;
+        case SIMD_AVX2: fill_random_avx2<D>(values_, begin, end, seed_); break;
+        default: fill_random_range<D>(values_, begin, end, seed_); break;
+        }
+#else
+        fill_random_range<D>(values_, begin, end, seed_);
+#endif
+    }
+}
+
+} //namespace detail
+
+/**
+  * Fills values_ with n_ values of the given distribution, using all
+  * threads with the same static partition as the first-touch allocators
+  * and the widest vectors the CPU has. Element i only depends on seed_ and i.
+  */
+template <typename T>
+void fill_random(T* values_, size_t n_, random_distribution distribution_ = RANDOM_UNIFORM, uint64_t seed_ = 0) {
+    switch (distribution_) {
+    case RANDOM_LOG_UNIFORM: detail::fill_random<RANDOM_LOG_UNIFORM>(values_, n_, seed_); break;
+    case RANDOM_CANCELLATION: detail::fill_random<RANDOM_CANCELLATION>(values_, n_, seed_); break;
+    default: detail::fill_random<RANDOM_UNIFORM>(values_, n_, seed_); break;
+    }
+}
+
+template <typename T, class Allocator>
+void fill_random(std::vector<T, Allocator>& values_, random_distribution distribution_ = RANDOM_UNIFORM, uint64_t seed_ = 0) {
+    fill_random(values_.data(), values_.size(), distribution_, seed_);
+}
+
+#endif
@@ -0,0 +1,721 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef REDUCTION_H_
+#define REDUCTION_H_
+
+#include <vector>
+#include <cstddef>
+#include <cmath>
+#include <iterator>
+#include <type_traits>
+#include <algorithm>
+#include <omp.h>
+
+#ifdef REDUCTION_STD_EXECUTION
+#include <execution>
+#include <numeric>
+#include <functional>
+#endif
+
+#include "compensated_summation.h"
+#include "numa.h"
+#include "superaccumulator.h"
+#include "work_stealing.h"
+
+/**
+  * Header-only summation library, where the algorithm, the execution and
+  * the accumulator type are template parameters, e.g.
+  *
+  *     reduction::reduce<reduction::kahan, reduction::openmp>(values)
+  *     reduction::reduce<reduction::naive, reduction::serial, double>(float_values)
+  *
+  * Everything is resolved at compile time, so each call site gets a kernel
+  * as tight as a hand-written one.
+  */
+namespace reduction {
+
+/**
+  * Algorithms
+  */
+struct naive {};    //Left to right, or an OpenMP reduction clause, so the result depends on the schedule.
+                    //Floats summed in double use 16 vectorized lanes instead.
+struct pairwise {}; //Blocks summed left to right, then a pairwise tree: identical for any number of threads
+struct cascade {};  //As pairwise, but the blocks are summed in interleaved lanes which vectorize
+struct kahan {};    //Kahan summation, vectorized for float and double
+struct neumaier {}; //Neumaier summation, which also handles values larger than the running sum
+struct exact {};    //Correctly rounded, for float and double
+
+/**
+  * Executions
+  */
+struct serial {};
+struct openmp {};
+struct work_stealing {}; //OpenMP threads balancing the load with per-thread deques, see work_stealing_for
+struct std_parallel {}; //std::execution::par_unseq, needs REDUCTION_STD_EXECUTION (and -ltbb with libstdc++)
+
+/**
+  * Random access iterator which returns the same value n times,
+  * to sum a constant without storing it
+  */
+template <typename T>
+class repeat_iterator {
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const T* pointer;
+    typedef const T& reference;
+
+    repeat_iterator(const T& value_, difference_type index_) : value(value_), index(index_) {}
+
+    const T& operator*() const { return value; }
+    const T& operator[](difference_type) const { return value; }
+    repeat_iterator& operator++() { ++index; return *this; }
+    repeat_iterator operator+(difference_type n_) const { return repeat_iterator(value, index + n_); }
+    difference_type operator-(const repeat_iterator& other_) const { return index - other_.index; }
+    bool operator==(const repeat_iterator& other_) const { return index == other_.index; }
+    bool operator!=(const repeat_iterator& other_) const { return index != other_.index; }
+
+private:
+    T value;
+    difference_type index;
+};
+
+/**
+  * Partial result of one thread, padded to a full cache line
+  * so that threads never write to the same cache line
+  */
+template <typename T>
+struct alignas(64) thread_partial {
+    compensated<T> value;
+};
+
+/**
+  * Pairwise tree with a fixed shape which is built one leaf at a time.
+  * Like a binary counter, only one complete subtree per level is kept,
+  * and the remaining subtrees are added from the right in result().
+  * This gives the same roundings as adding neighbours level by level.
+  */
+template <typename T>
+class pairwise_tree {
+public:
+    pairwise_tree() : depth(0), count(0) {}
+
+    void add(const T& value_) {
+        T carry = value_;
+        for (size_t c = count; c & 1; c >>= 1) {
+            carry = levels[--depth] + carry;
+        }
+        levels[depth++] = carry;
+        ++count;
+    }
+
+    T result() const {
+        if (depth == 0) {
+            return T(0.0);
+        }
+        T result = levels[depth-1];
+        for (int i = depth-1; i>0; --i) {
+            result = levels[i-1] + result;
+        }
+        return result;
+    }
+
+private:
+    T levels[64]; //One per bit of count
+    int depth;
+    size_t count;
+};
+
+/**
+  * Block size of the pairwise sum. Summing the values in chunks gives
+  * the same result as long as every chunk but the last is a multiple of this.
+  */
+static const size_t pairwise_block_size = 4096;
+
+/**
+  * Sums block block_ of the n_ values from left to right
+  */
+template <typename A, class Iterator>
+A pairwise_block(Iterator first_, size_t n_, size_t block_) {
+    const size_t begin = block_*pairwise_block_size;
+    const size_t end = std::min(begin + pairwise_block_size, n_);
+    A result = 0.0;
+    for (size_t j = begin; j<end; ++j) {
+        result = result + static_cast<A>(first_[j]);
+    }
+    return result;
+}
+
+/**
+  * Lanes of the cascade sum. Element i of a block goes to lane
+  * i % cascade_lanes, and the lanes are summed independently, so the
+  * compiler can keep them in vector registers without changing the result.
+  * A block of doubles fills 32 KiB, so the leaves stay in the L1 cache.
+  */
+static const int cascade_lanes = 16;
+
+/**
+  * Sums block block_ of the n_ values in cascade_lanes lanes,
+  * which are then added in a fixed pairwise tree
+  */
+template <typename A, class Iterator>
+A cascade_block(Iterator first_, size_t n_, size_t block_) {
+    const size_t begin = block_*pairwise_block_size;
+    const size_t end = std::min(begin + pairwise_block_size, n_);
+    A lanes[cascade_lanes];
+    for (int j=0; j<cascade_lanes; ++j) {
+        lanes[j] = 0.0;
+    }
+    size_t i = begin;
+    for (; i+cascade_lanes <= end; i += cascade_lanes) {
+        for (int j=0; j<cascade_lanes; ++j) {
+            lanes[j] = lanes[j] + static_cast<A>(first_[i+j]);
+        }
+    }
+    for (int j=0; i<end; ++i, ++j) {
+        lanes[j] = lanes[j] + static_cast<A>(first_[i]);
+    }
+    for (int width = cascade_lanes/2; width>0; width /= 2) {
+        for (int j=0; j<width; ++j) {
+            lanes[j] = lanes[j] + lanes[j+width];
+        }
+    }
+    return lanes[0];
+}
+
+/**
+  * Sums block block_ with the leaf kernel of Algorithm (pairwise or cascade)
+  */
+template <class Algorithm, typename A, class Iterator>
+A block_sum(Iterator first_, size_t n_, size_t block_) {
+    if constexpr (std::is_same<Algorithm, cascade>::value) {
+        return cascade_block<A>(first_, n_, block_);
+    }
+    else {
+        return pairwise_block<A>(first_, n_, block_);
+    }
+}
+
+/**
+  * Sums the values in blocks of pairwise_block_size, in parallel if
+  * parallel_ is set, and adds the block sums to tree_ in order
+  */
+template <class Algorithm = pairwise, typename A, class Iterator>
+void pairwise_accumulate(pairwise_tree<A>& tree_, Iterator first_, Iterator last_, bool parallel_) {
+    const size_t n = last_ - first_;
+    const long num_blocks = (n + pairwise_block_size - 1) / pairwise_block_size;
+    std::vector<A> block_results(num_blocks);
+
+    #pragma omp parallel for schedule(static) if(parallel_)
+    for (long i = 0; i<num_blocks; ++i) {
+        block_results[i] = block_sum<Algorithm, A>(first_, n, i);
+    }
+
+    for (long i = 0; i<num_blocks; ++i) {
+        tree_.add(block_results[i]);
+    }
+}
+
+/**
+  * Adds the values to initial_ from left to right
+  */
+template <typename A, class Iterator>
+A naive_accumulate(Iterator first_, Iterator last_, A initial_) {
+    A result = initial_;
+    for (; first_ != last_; ++first_) {
+        result += static_cast<A>(*first_);
+    }
+    return result;
+}
+
+namespace detail {
+
+template <class T>
+struct always_false : std::false_type {};
+
+/**
+  * Arrays of float summed in double, which have vectorized
+  * convert-and-add kernels
+  */
+template <typename A, class Iterator>
+struct is_widening {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    static const bool value = std::is_pointer<Iterator>::value 
+        && std::is_same<T, float>::value && std::is_same<A, double>::value;
+};
+
+/**
+  * Algorithms which sum fixed blocks and add them in a pairwise_tree
+  */
+template <class Algorithm>
+struct is_blocked {
+    static const bool value = std::is_same<Algorithm, pairwise>::value || std::is_same<Algorithm, cascade>::value;
+};
+
+template <typename Accumulator, class Iterator>
+struct accumulator_type {
+    typedef Accumulator type;
+};
+
+template <class Iterator>
+struct accumulator_type<void, Iterator> {
+    typedef typename std::iterator_traits<Iterator>::value_type type;
+};
+
+/**
+  * Kahan or Neumaier sum of a range. Arrays of float and double summed
+  * in their own precision use the vectorized kernels, which give the
+  * same result for every instruction set, and so do floats summed in double.
+  * The naive algorithm is only used here for floats summed in double.
+  */
+template <class Algorithm, typename A, class Iterator>
+compensated<A> compensated_sum(Iterator first_, Iterator last_) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    if constexpr (std::is_pointer<Iterator>::value && std::is_same<T, A>::value) {
+        if constexpr (std::is_same<Algorithm, kahan>::value) {
+            return kahan_sum_simd(first_, last_ - first_);
+        }
+        else {
+            return neumaier_sum_simd(first_, last_ - first_);
+        }
+    }
+    else if constexpr (is_widening<A, Iterator>::value && !std::is_same<Algorithm, neumaier>::value) {
+        compensated_lanes<A> state;
+        if constexpr (std::is_same<Algorithm, kahan>::value) {
+            kahan_accumulate(state, first_, last_ - first_);
+        }
+        else {
+            sum_accumulate(state, first_, last_ - first_);
+        }
+        return state.result();
+    }
+    else {
+        A sum = 0.0;
+        A error = 0.0;
+        for (; first_ != last_; ++first_) {
+            const A value = static_cast<A>(*first_);
+            if constexpr (std::is_same<Algorithm, kahan>::value) {
+                const A y = value + error;
+                const A t = sum + y;
+                error = y - (t - sum);
+                sum = t;
+            }
+            else {
+                const A t = sum + value;
+                if (std::abs(sum) >= std::abs(value)) {
+                    error += (sum - t) + value;
+                }
+                else {
+                    error += (value - t) + sum;
+                }
+                sum = t;
+            }
+        }
+        return compensated<A>(sum, error);
+    }
+}
+
+/**
+  * Each thread sums a contiguous part of the values, and the partial
+  * (sum, error) pairs are then merged using TwoSum in a pairwise tree,
+  * with one barrier per level instead of a lock, so that no compensation
+  * is lost.
+  */
+template <class Algorithm, typename A, class Iterator>
+compensated<A> parallel_compensated_sum(Iterator first_, Iterator last_) {
+    std::vector<thread_partial<A> > partials(omp_get_max_threads());
+    #pragma omp parallel
+    {
+        const size_t num_threads = omp_get_num_threads();
+        const size_t thread = omp_get_thread_num();
+        size_t begin, end;
+        static_partition(last_ - first_, thread, num_threads, begin, end);
+        partials[thread].value = compensated_sum<Algorithm, A>(first_ + begin, first_ + end);
+
+        for (size_t stride = 1; stride<num_threads; stride *= 2) {
+            #pragma omp barrier
+            if (thread % (2*stride) == 0 && thread+stride < num_threads) {
+                partials[thread].value = two_sum(partials[thread].value, partials[thread+stride].value);
+            }
+        }
+    }
+    return partials[0].value;
+}
+
+template <class Iterator>
+void exact_add(exact_accumulator& accumulator_, Iterator first_, Iterator last_) {
+    if constexpr (std::is_pointer<Iterator>::value) {
+        accumulator_.add(first_, last_ - first_);
+    }
+    else {
+        for (; first_ != last_; ++first_) {
+            accumulator_.add(static_cast<double>(*first_));
+        }
+    }
+}
+
+/**
+  * Each thread adds its part to an exact accumulator, and since merging
+  * accumulators is exact as well, the sum does not depend on the
+  * number of threads or the order of the values
+  */
+template <class Iterator>
+exact_accumulator exact_accumulate(Iterator first_, Iterator last_, bool parallel_) {
+    std::vector<exact_accumulator> partials(parallel_ ? omp_get_max_threads() : 1);
+    #pragma omp parallel if(parallel_)
+    {
+        size_t begin, end;
+        static_partition(last_ - first_, omp_get_thread_num(), omp_get_num_threads(), begin, end);
+        exact_add(partials[omp_get_thread_num()], first_ + begin, first_ + end);
+    }
+    for (size_t i=1; i<partials.size(); ++i) {
+        partials[0].add(partials[i]);
+    }
+    return partials[0];
+}
+
+template <typename A, class Iterator>
+A exact_sum(Iterator first_, Iterator last_, bool parallel_) {
+    return exact_accumulate(first_, last_, parallel_).template result<A>();
+}
+
+/**
+  * Elements per call of the kernels in work_stealing_sum, which is large
+  * enough for the vectorized kernels, and small enough to balance the load
+  */
+static const size_t work_stealing_grain = 4096;
+
+/**
+  * Work-stealing versions of the algorithms. The blocked and exact sums
+  * are still independent of the schedule, while the others merge the
+  * pieces each thread happened to get.
+  */
+template <class Algorithm, typename A, class Iterator>
+A work_stealing_sum(Iterator first_, Iterator last_) {
+    const size_t n = last_ - first_;
+    if constexpr (is_blocked<Algorithm>::value) {
+        const size_t num_blocks = (n + pairwise_block_size - 1) / pairwise_block_size;
+        std::vector<A> block_results(num_blocks);
+        work_stealing_for(num_blocks, 1, [&](int, size_t begin_, size_t end_) {
+            for (size_t i = begin_; i<end_; ++i) {
+                block_results[i] = block_sum<Algorithm, A>(first_, n, i);
+            }
+        });
+        pairwise_tree<A> tree;
+        for (size_t i = 0; i<num_blocks; ++i) {
+            tree.add(block_results[i]);
+        }
+        return tree.result();
+    }
+    else if constexpr (std::is_same<Algorithm, exact>::value) {
+        std::vector<exact_accumulator> partials(omp_get_max_threads());
+        work_stealing_for(n, work_stealing_grain, [&](int thread_, size_t begin_, size_t end_) {
+            exact_add(partials[thread_], first_ + begin_, first_ + end_);
+        });
+        for (size_t i=1; i<partials.size(); ++i) {
+            partials[0].add(partials[i]);
+        }
+        return partials[0].template result<A>();
+    }
+    else {
+        std::vector<thread_partial<A> > partials(omp_get_max_threads());
+        work_stealing_for(n, work_stealing_grain, [&](int thread_, size_t begin_, size_t end_) {
+            compensated<A>& partial = partials[thread_].value;
+            if constexpr (std::is_same<Algorithm, naive>::value && !is_widening<A, Iterator>::value) {
+                partial.sum = naive_accumulate(first_ + begin_, first_ + end_, partial.sum);
+            }
+            else {
+                partial = two_sum(partial, compensated_sum<Algorithm, A>(first_ + begin_, first_ + end_));
+            }
+        });
+        compensated<A> result;
+        for (size_t i=0; i<partials.size(); ++i) {
+            result = two_sum(result, partials[i].value);
+        }
+        return result.value();
+    }
+}
+
+#ifdef REDUCTION_STD_EXECUTION
+/**
+  * Leaves the order of the additions to the standard library. The
+  * compensated algorithms reduce (sum, error) pairs with TwoSum, which
+  * keeps the rounding error of every addition in any order.
+  */
+template <class Algorithm, typename A, class Iterator>
+A std_parallel_sum(Iterator first_, Iterator last_) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    if constexpr (std::is_same<Algorithm, naive>::value) {
+        return std::transform_reduce(std::execution::par_unseq, first_, last_, A(0.0), std::plus<A>(),
+            [](const T& value_) { return static_cast<A>(value_); });
+    }
+    else if constexpr (std::is_same<Algorithm, kahan>::value || std::is_same<Algorithm, neumaier>::value) {
+        return std::transform_reduce(std::execution::par_unseq, first_, last_, compensated<A>(),
+            [](const compensated<A>& a_, const compensated<A>& b_) { return two_sum(a_, b_); },
+            [](const T& value_) { return compensated<A>(static_cast<A>(value_), A(0.0)); }).value();
+    }
+    else {
+        static_assert(always_false<Algorithm>::value, "std_parallel supports naive, kahan and neumaier, use openmp for the others");
+    }
+}
+#endif
+
+} //namespace detail
+
+/**
+  * Sums the range [first_, last_) with the given algorithm and execution,
+  * using Accumulator for the sum (by default the value type of the range)
+  */
+template <class Algorithm, class Execution = serial, typename Accumulator = void, class Iterator>
+typename detail::accumulator_type<Accumulator, Iterator>::type reduce(Iterator first_, Iterator last_) {
+    typedef typename detail::accumulator_type<Accumulator, Iterator>::type A;
+    constexpr bool parallel = std::is_same<Execution, openmp>::value;
+    static_assert(parallel || std::is_same<Execution, serial>::value || std::is_same<Execution, work_stealing>::value 
+                  || std::is_same<Execution, std_parallel>::value, 
+        "Execution must be serial, openmp, work_stealing or std_parallel");
+    static_assert(std::is_same<Algorithm, naive>::value || detail::is_blocked<Algorithm>::value
+                  || std::is_same<Algorithm, kahan>::value || std::is_same<Algorithm, neumaier>::value
+                  || std::is_same<Algorithm, exact>::value,
+        "Algorithm must be naive, pairwise, cascade, kahan, neumaier or exact");
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    static_assert(!std::is_same<Algorithm, exact>::value 
+                  || ((std::is_same<T, float>::value || std::is_same<T, double>::value) 
+                      && (std::is_same<A, float>::value || std::is_same<A, double>::value)),
+        "exact only supports float and double");
+
+    if constexpr (std::is_same<Execution, std_parallel>::value) {
+#ifdef REDUCTION_STD_EXECUTION
+        return detail::std_parallel_sum<Algorithm, A>(first_, last_);
+#else
+        static_assert(detail::always_false<Algorithm>::value, "std_parallel needs REDUCTION_STD_EXECUTION to be defined");
+#endif
+    }
+    else if constexpr (std::is_same<Execution, work_stealing>::value) {
+        return detail::work_stealing_sum<Algorithm, A>(first_, last_);
+    }
+    else if constexpr (std::is_same<Algorithm, naive>::value && detail::is_widening<A, Iterator>::value) {
+        if constexpr (parallel) {
+            return detail::parallel_compensated_sum<Algorithm, A>(first_, last_).value();
+        }
+        else {
+            return detail::compensated_sum<Algorithm, A>(first_, last_).value();
+        }
+    }
+    else if constexpr (std::is_same<Algorithm, naive>::value) {
+        if constexpr (parallel) {
+            const long n = last_ - first_;
+            A result = 0.0;
+            #pragma omp parallel for schedule(dynamic, 50) reduction(+:result)
+            for (long i = 0; i<n; ++i) {
+                result += static_cast<A>(first_[i]);
+            }
+            return result;
+        }
+        else {
+            return naive_accumulate(first_, last_, A(0.0));
+        }
+    }
+    else if constexpr (detail::is_blocked<Algorithm>::value) {
+        pairwise_tree<A> tree;
+        pairwise_accumulate<Algorithm>(tree, first_, last_, parallel);
+        return tree.result();
+    }
+    else if constexpr (std::is_same<Algorithm, kahan>::value || std::is_same<Algorithm, neumaier>::value) {
+        if constexpr (parallel) {
+            return detail::parallel_compensated_sum<Algorithm, A>(first_, last_).value();
+        }
+        else {
+            return detail::compensated_sum<Algorithm, A>(first_, last_).value();
+        }
+    }
+    else {
+        return detail::exact_sum<A>(first_, last_, parallel);
+    }
+}
+
+template <class Algorithm, class Execution = serial, typename Accumulator = void, typename T, class Allocator>
+typename detail::accumulator_type<Accumulator, const T*>::type reduce(const std::vector<T, Allocator>& values_) {
+    return reduce<Algorithm, Execution, Accumulator>(values_.data(), values_.data() + values_.size());
+}
+
+/**
+  * Read-only view of an array, for reduce_batch
+  */
+template <typename T>
+struct span {
+    const T* data;
+    size_t size;
+
+    span(const T* data_, size_t size_) : data(data_), size(size_) {}
+
+    template <class Allocator>
+    span(const std::vector<T, Allocator>& values_) : data(values_.data()), size(values_.size()) {}
+};
+
+namespace detail {
+
+/**
+  * Part of one array in a batch, where offset is the index of
+  * the first element counting all the arrays before it
+  */
+struct batch_block {
+    size_t array;
+    size_t begin;
+    size_t end;
+    size_t offset;
+};
+
+} //namespace detail
+
+/**
+  * Sums many arrays in a single parallel region, instead of paying for
+  * the start and end of one region per array. The arrays are cut into
+  * blocks of pairwise_block_size, and each thread takes the contiguous run
+  * of blocks that holds its share of all the elements. Small arrays are
+  * thus packed together on one thread, and large arrays are split between
+  * threads, whose partial sums are merged in thread order afterwards. The
+  * blocked and exact sums are the same as from reduce on each array.
+  */
+template <class Algorithm, typename Accumulator = void, typename T>
+std::vector<typename detail::accumulator_type<Accumulator, const T*>::type> reduce_batch(const std::vector<span<T> >& arrays_) {
+    typedef typename detail::accumulator_type<Accumulator, const T*>::type A;
+    typedef typename std::conditional<std::is_same<Algorithm, exact>::value, exact_accumulator, compensated<A> >::type partial_type;
+    constexpr bool plain = std::is_same<Algorithm, naive>::value && !detail::is_widening<A, const T*>::value;
+
+    std::vector<detail::batch_block> blocks;
+    std::vector<size_t> array_blocks(arrays_.size() + 1);
+    size_t total = 0;
+    for (size_t i=0; i<arrays_.size(); ++i) {
+        array_blocks[i] = blocks.size();
+        for (size_t begin=0; begin<arrays_[i].size; begin += pairwise_block_size) {
+            detail::batch_block block = { i, begin, std::min(begin + pairwise_block_size, arrays_[i].size), total + begin };
+            blocks.push_back(block);
+        }
+        total += arrays_[i].size;
+    }
+    array_blocks[arrays_.size()] = blocks.size();
+
+    std::vector<A> results(arrays_.size(), A(0.0));
+    std::vector<A> block_results(detail::is_blocked<Algorithm>::value ? blocks.size() : 0);
+    std::vector<std::vector<std::pair<size_t, partial_type> > > partials(omp_get_max_threads());
+
+    #pragma omp parallel
+    {
+        const int thread = omp_get_thread_num();
+        size_t first_element, last_element;
+        static_partition(total, thread, omp_get_num_threads(), first_element, last_element);
+        const auto before = [](const detail::batch_block& block_, size_t offset_) { return block_.offset < offset_; };
+        const size_t first_block = std::lower_bound(blocks.begin(), blocks.end(), first_element, before) - blocks.begin();
+        const size_t last_block = std::lower_bound(blocks.begin(), blocks.end(), last_element, before) - blocks.begin();
+
+        std::vector<std::pair<size_t, partial_type> >& own = partials[thread];
+        for (size_t b=first_block; b<last_block; ++b) {
+            const detail::batch_block& block = blocks[b];
+            const T* values = arrays_[block.array].data;
+            if constexpr (detail::is_blocked<Algorithm>::value) {
+                block_results[b] = block_sum<Algorithm, A>(values, arrays_[block.array].size, block.begin / pairwise_block_size);
+                continue;
+            }
+
+            if (own.empty() || own.back().first != block.array) {
+                own.push_back(std::make_pair(block.array, partial_type()));
+            }
+            partial_type& partial = own.back().second;
+            if constexpr (std::is_same<Algorithm, exact>::value) {
+                detail::exact_add(partial, values + block.begin, values + block.end);
+            }
+            else if constexpr (plain) {
+                partial.sum = naive_accumulate(values + block.begin, values + block.end, partial.sum);
+            }
+            else {
+                partial = two_sum(partial, detail::compensated_sum<Algorithm, A>(values + block.begin, values + block.end));
+            }
+        }
+
+        if constexpr (detail::is_blocked<Algorithm>::value) {
+            #pragma omp barrier
+            #pragma omp for schedule(static)
+            for (long i=0; i<static_cast<long>(arrays_.size()); ++i) {
+                pairwise_tree<A> tree;
+                for (size_t b=array_blocks[i]; b<array_blocks[i+1]; ++b) {
+                    tree.add(block_results[b]);
+                }
+                results[i] = tree.result();
+            }
+        }
+    }
+
+    //The parts of an array are on consecutive threads
+    partial_type* current = NULL;
+    size_t current_array = 0;
+    const auto finish = [&]() {
+        if constexpr (std::is_same<Algorithm, exact>::value) {
+            results[current_array] = current->template result<A>();
+        }
+        else if constexpr (plain) {
+            results[current_array] = current->sum;
+        }
+        else {
+            results[current_array] = current->value();
+        }
+    };
+    for (size_t t=0; t<partials.size(); ++t) {
+        for (size_t j=0; j<partials[t].size(); ++j) {
+            partial_type& partial = partials[t][j].second;
+            if (current != NULL && current_array == partials[t][j].first) {
+                if constexpr (std::is_same<Algorithm, exact>::value) {
+                    current->add(partial);
+                }
+                else if constexpr (plain) {
+                    current->sum += partial.sum;
+                }
+                else {
+                    *current = two_sum(*current, partial);
+                }
+            }
+            else {
+                if (current != NULL) {
+                    finish();
+                }
+                current = &partial;
+                current_array = partials[t][j].first;
+            }
+        }
+    }
+    if (current != NULL) {
+        finish();
+    }
+    return results;
+}
+
+} //namespace reduction
+
+#endif
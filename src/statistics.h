@@ -0,0 +1,358 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef STATISTICS_H_
+#define STATISTICS_H_
+
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <type_traits>
+#include <omp.h>
+
+#include "compensated_summation.h"
+#include "numa.h"
+#include "reduction.h"
+
+namespace reduction {
+
+/**
+  * Count, sum, mean, variance, min and max of a set of values. The sum is
+  * compensated, and the variance is kept as the sum of squared deviations
+  * from the mean, so that statistics of different parts of the data can be
+  * merged without the cancellation of the textbook sum of squares formula.
+  */
+template <typename T>
+struct statistics {
+    size_t count;
+    compensated<T> sum;
+    T squares; //Sum of squared deviations from the mean
+    T min;
+    T max;
+
+    statistics() : count(0), squares(0.0),
+        min(std::numeric_limits<T>::infinity()), max(-std::numeric_limits<T>::infinity()) {}
+
+    T mean() const {
+        return (count > 0) ? sum.value() / static_cast<T>(count) : std::numeric_limits<T>::quiet_NaN();
+    }
+
+    /**
+      * Population variance, divided by count
+      */
+    T variance() const {
+        return (count > 0) ? squares / static_cast<T>(count) : std::numeric_limits<T>::quiet_NaN();
+    }
+
+    /**
+      * Sample variance, divided by count-1
+      */
+    T sample_variance() const {
+        return (count > 1) ? squares / static_cast<T>(count - 1) : std::numeric_limits<T>::quiet_NaN();
+    }
+
+    /**
+      * Adds the statistics of other values, using the pairwise update of
+      * Chan, Golub and LeVeque for the squared deviations
+      */
+    void merge(const statistics& other_) {
+        if (other_.count == 0) {
+            return;
+        }
+        if (count == 0) {
+            *this = other_;
+            return;
+        }
+        const T count_a = static_cast<T>(count);
+        const T count_b = static_cast<T>(other_.count);
+        const T delta = other_.mean() - mean();
+        squares = squares + other_.squares + delta*delta*(count_a*count_b/(count_a + count_b));
+        sum = two_sum(sum, other_.sum);
+        count += other_.count;
+        min = (other_.min < min) ? other_.min : min;
+        max = (other_.max > max) ? other_.max : max;
+    }
+};
+
+namespace detail {
+
+/**
+  * State of the fused single pass, in independent lanes as compensated_lanes:
+  * element i goes to lane i % lanes, so every instruction set gives the same
+  * result. Each lane has a Kahan sum of the values, a Kahan sum of the
+  * squared differences from shift, and the min and max. With a shift close
+  * to the mean, the squared deviations follow without cancellation.
+  */
+template <typename T>
+struct statistics_lanes {
+    static const int lanes = 128 / sizeof(T);
+    T shift;
+    size_t count;
+    T sum[lanes];
+    T sum_error[lanes];
+    T squares[lanes];
+    T squares_error[lanes];
+    T min[lanes];
+    T max[lanes];
+
+    explicit statistics_lanes(T shift_) : shift(shift_), count(0) {
+        for (int i=0; i<lanes; ++i) {
+            sum[i] = 0.0;
+            sum_error[i] = 0.0;
+            squares[i] = 0.0;
+            squares_error[i] = 0.0;
+            min[i] = std::numeric_limits<T>::infinity();
+            max[i] = -std::numeric_limits<T>::infinity();
+        }
+    }
+
+    /**
+      * Folds the lanes in a fixed order
+      */
+    statistics<T> result() const {
+        statistics<T> result;
+        compensated<T> shifted_squares;
+        for (int i=0; i<lanes; ++i) {
+            result.sum = two_sum(result.sum, compensated<T>(sum[i], sum_error[i]));
+            shifted_squares = two_sum(shifted_squares, compensated<T>(squares[i], squares_error[i]));
+            result.min = (min[i] < result.min) ? min[i] : result.min;
+            result.max = (max[i] > result.max) ? max[i] : result.max;
+        }
+        result.count = count;
+        if (count > 0) {
+            //Sum of the differences from shift, with the rounding error of n*shift from an FMA
+            const T n = static_cast<T>(count);
+            const T product = n*shift;
+            const T product_error = std::fma(n, shift, -product);
+            const T difference = ((result.sum.sum - product) - product_error) + result.sum.error;
+            const T deviations = shifted_squares.value() - difference*difference/n;
+            result.squares = (deviations > 0) ? deviations : T(0.0);
+        }
+        return result;
+    }
+};
+
+/**
+  * One lane step per value. The min and max keep the lane value when
+  * either is NaN, like the vector instructions, so NaNs only show in the sum.
+  */
+template <typename T, typename S>
+void statistics_accumulate_scalar(statistics_lanes<T>& state_, const S* values_, size_t n_) {
+    const int lanes = statistics_lanes<T>::lanes;
+    for (size_t i=0; i<n_; i+=lanes) {
+        const int count = (n_-i < static_cast<size_t>(lanes)) ? static_cast<int>(n_-i) : lanes;
+        for (int j=0; j<count; ++j) {
+            const T x = static_cast<T>(values_[i+j]);
+            T y = x + state_.sum_error[j];
+            T t = state_.sum[j] + y;
+            state_.sum_error[j] = y - (t - state_.sum[j]);
+            state_.sum[j] = t;
+
+            const T d = x - state_.shift;
+            y = d*d + state_.squares_error[j];
+            t = state_.squares[j] + y;
+            state_.squares_error[j] = y - (t - state_.squares[j]);
+            state_.squares[j] = t;
+
+            state_.min[j] = (x < state_.min[j]) ? x : state_.min[j];
+            state_.max[j] = (x > state_.max[j]) ? x : state_.max[j];
+        }
+    }
+    state_.count += n_;
+}
+
+#ifdef COMPENSATED_SUMMATION_X86
+
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+/**
+  * Vectorized fused pass over whole multiples of the lanes, returning how
+  * many values it consumed. The remainder is left to the scalar kernel, which
+  * is called outside of the kernels compiled for AVX-512 so that it is never
+  * contracted to FMA instructions.
+  */
+template <class V, typename T, typename S>
+inline size_t statistics_accumulate_simd(statistics_lanes<T>& state_, const S* values_, size_t n_) {
+    typedef typename V::vec vec;
+    const int lanes = statistics_lanes<T>::lanes;
+    const int registers = lanes / V::width;
+
+    vec sum[registers];
+    vec sum_error[registers];
+    vec squares[registers];
+    vec squares_error[registers];
+    vec min[registers];
+    vec max[registers];
+    for (int j=0; j<registers; ++j) {
+        sum[j] = V::load(state_.sum + j*V::width);
+        sum_error[j] = V::load(state_.sum_error + j*V::width);
+        squares[j] = V::load(state_.squares + j*V::width);
+        squares_error[j] = V::load(state_.squares_error + j*V::width);
+        min[j] = V::load(state_.min + j*V::width);
+        max[j] = V::load(state_.max + j*V::width);
+    }
+    const vec shift = V::set1(state_.shift);
+
+    size_t i = 0;
+    for (; i+lanes<=n_; i+=lanes) {
+        for (int j=0; j<registers; ++j) {
+            const vec x = V::load(values_ + i + j*V::width);
+            vec y = V::add(x, sum_error[j]);
+            vec t = V::add(sum[j], y);
+            sum_error[j] = V::sub(y, V::sub(t, sum[j]));
+            sum[j] = t;
+
+            const vec d = V::sub(x, shift);
+            y = V::add(V::mul(d, d), squares_error[j]);
+            t = V::add(squares[j], y);
+            squares_error[j] = V::sub(y, V::sub(t, squares[j]));
+            squares[j] = t;
+
+            min[j] = V::min(x, min[j]);
+            max[j] = V::max(x, max[j]);
+        }
+    }
+
+    for (int j=0; j<registers; ++j) {
+        V::store(state_.sum + j*V::width, sum[j]);
+        V::store(state_.sum_error + j*V::width, sum_error[j]);
+        V::store(state_.squares + j*V::width, squares[j]);
+        V::store(state_.squares_error + j*V::width, squares_error[j]);
+        V::store(state_.min + j*V::width, min[j]);
+        V::store(state_.max + j*V::width, max[j]);
+    }
+    state_.count += i;
+    return i;
+}
+
+inline size_t statistics_sse2(statistics_lanes<float>& s_, const float* v_, size_t n_) { return statistics_accumulate_simd<::detail::sse2_float>(s_, v_, n_); }
+inline size_t statistics_sse2(statistics_lanes<double>& s_, const double* v_, size_t n_) { return statistics_accumulate_simd<::detail::sse2_double>(s_, v_, n_); }
+inline size_t statistics_sse2(statistics_lanes<double>& s_, const float* v_, size_t n_) { return statistics_accumulate_simd<::detail::sse2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx2") size_t statistics_avx2(statistics_lanes<float>& s_, const float* v_, size_t n_) { return statistics_accumulate_simd<::detail::avx2_float>(s_, v_, n_); }
+inline SIMD_KERNEL("avx2") size_t statistics_avx2(statistics_lanes<double>& s_, const double* v_, size_t n_) { return statistics_accumulate_simd<::detail::avx2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx2") size_t statistics_avx2(statistics_lanes<double>& s_, const float* v_, size_t n_) { return statistics_accumulate_simd<::detail::avx2_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx512f") size_t statistics_avx512(statistics_lanes<float>& s_, const float* v_, size_t n_) { return statistics_accumulate_simd<::detail::avx512_float>(s_, v_, n_); }
+inline SIMD_KERNEL("avx512f") size_t statistics_avx512(statistics_lanes<double>& s_, const double* v_, size_t n_) { return statistics_accumulate_simd<::detail::avx512_double>(s_, v_, n_); }
+inline SIMD_KERNEL("avx512f") size_t statistics_avx512(statistics_lanes<double>& s_, const float* v_, size_t n_) { return statistics_accumulate_simd<::detail::avx512_double>(s_, v_, n_); }
+
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+/**
+  * Adds n_ values to the lanes with the widest vectors the CPU has.
+  * Other types than float and double, or float in double, use the scalar lanes.
+  */
+template <typename T, typename S>
+void statistics_accumulate(statistics_lanes<T>& state_, const S* values_, size_t n_) {
+    size_t done = 0;
+#ifdef COMPENSATED_SUMMATION_X86
+    if constexpr ((std::is_same<T, float>::value || std::is_same<T, double>::value)
+                  && (std::is_same<S, T>::value || std::is_same<S, float>::value)) {
+        switch (get_simd_level()) {
+        case SIMD_AVX512: done = statistics_avx512(state_, values_, n_); break;
+        case SIMD_AVX2: done = statistics_avx2(state_, values_, n_); break;
+        case SIMD_SSE2: done = statistics_sse2(state_, values_, n_); break;
+        default: break;
+        }
+    }
+#endif
+    statistics_accumulate_scalar(state_, values_ + done, n_ - done);
+}
+
+/**
+  * Partial statistics of one thread, padded to full cache lines
+  */
+template <typename T>
+struct alignas(64) thread_statistics {
+    statistics<T> value;
+};
+
+} //namespace detail
+
+/**
+  * Count, sum, mean, variance, min and max of the values in a single pass,
+  * instead of one pass over the memory for each of them. Each thread keeps
+  * its own lanes over a contiguous part, and the parts are merged in thread
+  * order, so the result only depends on the number of threads, e.g.
+  *
+  *     reduction::statistics<double> s = reduction::compute_statistics<reduction::openmp>(values);
+  *     s.mean(); s.variance(); s.min; s.max;
+  *
+  * The first value is used as the shift for the squared deviations.
+  * Execution is serial or openmp, and Accumulator defaults to the value
+  * type, e.g., double for the statistics of floats in double precision.
+  */
+template <class Execution = serial, typename Accumulator = void, typename T>
+statistics<typename detail::accumulator_type<Accumulator, const T*>::type> compute_statistics(const T* first_, const T* last_) {
+    typedef typename detail::accumulator_type<Accumulator, const T*>::type A;
+    static_assert(std::is_same<Execution, serial>::value || std::is_same<Execution, openmp>::value,
+        "compute_statistics supports the serial and openmp executions");
+    const size_t n = last_ - first_;
+    const A shift = (n > 0) ? static_cast<A>(*first_) : A(0.0);
+
+    if constexpr (std::is_same<Execution, serial>::value) {
+        detail::statistics_lanes<A> state(shift);
+        detail::statistics_accumulate(state, first_, n);
+        return state.result();
+    }
+    else {
+        std::vector<detail::thread_statistics<A> > partials(omp_get_max_threads());
+        #pragma omp parallel
+        {
+            const size_t thread = omp_get_thread_num();
+            size_t begin, end;
+            static_partition(n, thread, omp_get_num_threads(), begin, end);
+            detail::statistics_lanes<A> state(shift);
+            detail::statistics_accumulate(state, first_ + begin, end - begin);
+            partials[thread].value = state.result();
+        }
+
+        statistics<A> result;
+        for (size_t i=0; i<partials.size(); ++i) {
+            result.merge(partials[i].value);
+        }
+        return result;
+    }
+}
+
+template <class Execution = serial, typename Accumulator = void, typename T, class Allocator>
+statistics<typename detail::accumulator_type<Accumulator, const T*>::type> compute_statistics(const std::vector<T, Allocator>& values_) {
+    return compute_statistics<Execution, Accumulator>(values_.data(), values_.data() + values_.size());
+}
+
+} //namespace reduction
+
+#endif
@@ -0,0 +1,407 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef SUPERACCUMULATOR_H_
+#define SUPERACCUMULATOR_H_
+
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdint.h>
+
+#include "double_double.h"
+
+/**
+  * Fixed-point accumulator which holds the exact sum of any number of
+  * doubles. The bits from 2^-1074 (the smallest denormal) and up are stored
+  * in chunks of 32 bits, each kept in a signed 64 bit integer so that
+  * about 2^31 values can be added before the carries have to be propagated.
+  * Adding a double touches at most three chunks, and no rounding happens
+  * until the result is read, which makes the sum independent of the order.
+  */
+class superaccumulator {
+public:
+    superaccumulator() : additions(0), nan(false), positive_infinity(false), negative_infinity(false) {
+        memset(chunks, 0, sizeof(chunks));
+    }
+
+    void add(double value_) {
+        uint64_t bits;
+        memcpy(&bits, &value_, sizeof(bits));
+        const int exponent = static_cast<int>((bits >> 52) & 0x7ff);
+        uint64_t mantissa = bits & ((uint64_t(1) << 52) - 1);
+
+        if (exponent == 0x7ff) {
+            if (mantissa != 0) {
+                nan = true;
+            }
+            else if (bits >> 63) {
+                negative_infinity = true;
+            }
+            else {
+                positive_infinity = true;
+            }
+            return;
+        }
+
+        //Value is mantissa * 2^(position-1074)
+        int position = 0;
+        if (exponent != 0) {
+            mantissa |= uint64_t(1) << 52;
+            position = exponent - 1;
+        }
+        if (mantissa == 0) {
+            return;
+        }
+
+        if (additions == max_additions) {
+            normalize();
+        }
+        ++additions;
+
+        //Splits the up to 84 bits of mantissa << offset into three chunks,
+        //shifting the two halves of the mantissa separately so that
+        //nothing overflows 64 bits
+        const int chunk = position / chunk_bits;
+        const int offset = position % chunk_bits;
+        const uint64_t low_half = (mantissa & chunk_mask) << offset;
+        const uint64_t high_half = (mantissa >> chunk_bits) << offset;
+        const uint64_t middle = (low_half >> chunk_bits) + (high_half & chunk_mask);
+        const int64_t lo = static_cast<int64_t>(low_half & chunk_mask);
+        const int64_t mid = static_cast<int64_t>(middle & chunk_mask);
+        const int64_t hi = static_cast<int64_t>((high_half >> chunk_bits) + (middle >> chunk_bits));
+        if (bits >> 63) {
+            chunks[chunk] -= lo;
+            chunks[chunk+1] -= mid;
+            chunks[chunk+2] -= hi;
+        }
+        else {
+            chunks[chunk] += lo;
+            chunks[chunk+1] += mid;
+            chunks[chunk+2] += hi;
+        }
+    }
+
+    /**
+      * Adds another accumulator, which is exact, so partial sums
+      * can be merged in any order
+      */
+    void add(const superaccumulator& other_) {
+        superaccumulator other = other_;
+        other.normalize();
+        normalize();
+        for (int i=0; i<num_chunks; ++i) {
+            chunks[i] += other.chunks[i];
+        }
+        additions = 1;
+        nan = nan || other.nan;
+        positive_infinity = positive_infinity || other.positive_infinity;
+        negative_infinity = negative_infinity || other.negative_infinity;
+    }
+
+    /**
+      * Returns the exact sum correctly rounded (to nearest, ties to even)
+      * to float or double. Rounding directly from the exact sum, instead of
+      * via double for floats, avoids double rounding.
+      */
+    template <typename T>
+    T round() const {
+        if (nan || (positive_infinity && negative_infinity)) {
+            return std::numeric_limits<T>::quiet_NaN();
+        }
+        if (positive_infinity) {
+            return std::numeric_limits<T>::infinity();
+        }
+        if (negative_infinity) {
+            return -std::numeric_limits<T>::infinity();
+        }
+
+        //Work on the magnitude, with every chunk in [0, 2^32)
+        superaccumulator magnitude = *this;
+        magnitude.normalize();
+        const bool negative = magnitude.chunks[num_chunks-1] < 0;
+        if (negative) {
+            for (int i=0; i<num_chunks; ++i) {
+                magnitude.chunks[i] = -magnitude.chunks[i];
+            }
+            magnitude.normalize();
+        }
+
+        int top = num_chunks-1;
+        while (top >= 0 && magnitude.chunks[top] == 0) {
+            --top;
+        }
+        if (top < 0) {
+            return T(0.0);
+        }
+
+        //Bit i of the magnitude has the value 2^(i-1074)
+        int leading = top*chunk_bits + chunk_bits - 1;
+        while (!magnitude.bit(leading)) {
+            --leading;
+        }
+
+        //Position of the last bit that fits in T, limited by its denormals
+        const int denormal_position = std::numeric_limits<T>::min_exponent - std::numeric_limits<T>::digits + 1074;
+        const int last = std::max(leading - std::numeric_limits<T>::digits + 1, denormal_position);
+
+        uint64_t mantissa = 0;
+        for (int i=leading; i>=last; --i) {
+            mantissa = (mantissa << 1) | (magnitude.bit(i) ? 1 : 0);
+        }
+        //Below the smallest denormal of double there is nothing to round
+        const int half = last-1;
+        if (half >= 0 && magnitude.bit(half)) {
+            //Ties are decided by whether anything below the rounding bit is non-zero
+            bool sticky = (magnitude.chunks[half / chunk_bits] & ((int64_t(1) << (half % chunk_bits)) - 1)) != 0;
+            for (int i=0; i<half / chunk_bits; ++i) {
+                sticky = sticky || (magnitude.chunks[i] != 0);
+            }
+            if (sticky || (mantissa & 1)) {
+                ++mantissa;
+            }
+        }
+        const int exponent = last - 1074;
+
+        const T result = std::ldexp(static_cast<T>(mantissa), exponent);
+        return negative ? -result : result;
+    }
+
+    /**
+      * Writes the sum to buffer_ as a sign and the non-zero range of its
+      * magnitude, which is a few tens of bytes for typical sums and never
+      * more than max_serialized_size. The chunks are in the byte order of
+      * the host. Returns the number of bytes written.
+      */
+    size_t serialize(unsigned char* buffer_) const {
+        superaccumulator magnitude = *this;
+        magnitude.normalize();
+        const bool negative = magnitude.chunks[num_chunks-1] < 0;
+        if (negative) {
+            for (int i=0; i<num_chunks; ++i) {
+                magnitude.chunks[i] = -magnitude.chunks[i];
+            }
+            magnitude.normalize();
+        }
+
+        int first = 0;
+        while (first < num_chunks && magnitude.chunks[first] == 0) {
+            ++first;
+        }
+        int last = num_chunks;
+        while (last > first && magnitude.chunks[last-1] == 0) {
+            --last;
+        }
+
+        //Even 2^31 of the largest doubles stay below the top chunk,
+        //so every chunk of the magnitude fits in 32 bits
+        buffer_[0] = (nan ? 1 : 0) | (positive_infinity ? 2 : 0) | (negative_infinity ? 4 : 0) | (negative ? 8 : 0);
+        buffer_[1] = static_cast<unsigned char>(first);
+        buffer_[2] = static_cast<unsigned char>(last - first);
+        for (int i=first; i<last; ++i) {
+            const uint32_t chunk = static_cast<uint32_t>(magnitude.chunks[i]);
+            memcpy(buffer_ + 3 + 4*(i-first), &chunk, sizeof(chunk));
+        }
+        return 3 + 4*(last - first);
+    }
+
+    /**
+      * Reads a sum written by serialize. Returns the number of bytes
+      * read, or 0 if the first size_ bytes of buffer_ are not a valid sum.
+      */
+    size_t deserialize(const unsigned char* buffer_, size_t size_) {
+        if (size_ < 3 || buffer_[0] > 15 || buffer_[1] + buffer_[2] > num_chunks || size_ < 3 + 4*size_t(buffer_[2])) {
+            return 0;
+        }
+        *this = superaccumulator();
+        nan = (buffer_[0] & 1) != 0;
+        positive_infinity = (buffer_[0] & 2) != 0;
+        negative_infinity = (buffer_[0] & 4) != 0;
+        const bool negative = (buffer_[0] & 8) != 0;
+        for (int i=0; i<buffer_[2]; ++i) {
+            uint32_t chunk;
+            memcpy(&chunk, buffer_ + 3 + 4*i, sizeof(chunk));
+            chunks[buffer_[1] + i] = negative ? -static_cast<int64_t>(chunk) : static_cast<int64_t>(chunk);
+        }
+        return 3 + 4*size_t(buffer_[2]);
+    }
+
+    static const size_t max_serialized_size = 3 + 4*68;
+
+private:
+    static const int chunk_bits = 32;
+    static const int num_chunks = 68; //2^-1074 to above 2^1024, with room for carries
+    static const uint64_t chunk_mask = 0xffffffffu;
+    static const int max_additions = 1 << 30;
+
+    /**
+      * Propagates the carries, so that all chunks but the top one are in [0, 2^32)
+      */
+    void normalize() {
+        for (int i=0; i<num_chunks-1; ++i) {
+            const int64_t carry = chunks[i] >> chunk_bits;
+            chunks[i] &= chunk_mask;
+            chunks[i+1] += carry;
+        }
+        additions = 0;
+    }
+
+    /**
+      * Bit i of a normalized, non-negative accumulator
+      */
+    bool bit(int i_) const {
+        return ((chunks[i_ / chunk_bits] >> (i_ % chunk_bits)) & 1) != 0;
+    }
+
+    int64_t chunks[num_chunks];
+    int additions;
+    bool nan;
+    bool positive_infinity;
+    bool negative_infinity;
+};
+
+/**
+  * Exact accumulator with a floating point expansion in front of the
+  * superaccumulator, as in ExBLAS (Collange, Defour, Graillat and Iakymchuk).
+  * Each value is added to the expansion with TwoSum, which moves the rounding
+  * error one term down. Only when the last term cannot hold the error either
+  * does it go to the superaccumulator, so most values never touch memory.
+  * The expansion plus the superaccumulator is always exactly the sum.
+  * Arrays are spread over independent expansions, so that consecutive
+  * values do not wait for each other's TwoSum. Each accumulator fills
+  * whole cache lines, so those of different threads can be kept together.
+  */
+class alignas(64) exact_accumulator {
+public:
+    exact_accumulator() {
+        for (int i=0; i<lanes; ++i) {
+            for (int j=0; j<terms; ++j) {
+                expansion[i][j] = 0.0;
+            }
+        }
+    }
+
+    void add(double value_) {
+        add(0, value_);
+    }
+
+    template <typename T>
+    void add(const T* values_, size_t n_) {
+        size_t i = 0;
+        for (; i+lanes<=n_; i += lanes) {
+            for (int j=0; j<lanes; ++j) {
+                add(j, static_cast<double>(values_[i+j]));
+            }
+        }
+        for (; i<n_; ++i) {
+            add(0, static_cast<double>(values_[i]));
+        }
+    }
+
+    void add(const exact_accumulator& other_) {
+        accumulator.add(other_.flushed());
+    }
+
+    template <typename T>
+    T result() const {
+        return flushed().round<T>();
+    }
+
+    /**
+      * Writes the exact sum, see superaccumulator::serialize
+      */
+    size_t serialize(unsigned char* buffer_) const {
+        return flushed().serialize(buffer_);
+    }
+
+    /**
+      * Replaces the sum with one written by serialize. Returns the number
+      * of bytes read, or 0 (leaving the sum untouched) if they are not valid.
+      */
+    size_t deserialize(const unsigned char* buffer_, size_t size_) {
+        superaccumulator sum;
+        const size_t read = sum.deserialize(buffer_, size_);
+        if (read > 0) {
+            *this = exact_accumulator();
+            accumulator = sum;
+        }
+        return read;
+    }
+
+    static const size_t max_serialized_size = superaccumulator::max_serialized_size;
+
+private:
+    static const int lanes = 4;
+    static const int terms = 3;
+
+    void add(int lane_, double value_) {
+        //Huge values could overflow the expansion, and non-finite
+        //values must not go through TwoSum
+        if (!(std::fabs(value_) < 1.0e290)) {
+            accumulator.add(value_);
+            return;
+        }
+        for (int i=0; i<terms; ++i) {
+            double error;
+            expansion[lane_][i] = multi_double::two_sum(expansion[lane_][i], value_, error);
+            value_ = error;
+            if (value_ == 0.0) {
+                return;
+            }
+        }
+        accumulator.add(value_);
+    }
+
+    superaccumulator flushed() const {
+        superaccumulator result = accumulator;
+        for (int i=0; i<lanes; ++i) {
+            for (int j=0; j<terms; ++j) {
+                result.add(expansion[i][j]);
+            }
+        }
+        return result;
+    }
+
+    double expansion[lanes][terms];
+    superaccumulator accumulator;
+};
+
+/**
+  * Correctly rounded sum of n_ floats or doubles
+  */
+template <typename T>
+T exact_sum(const T* values_, size_t n_) {
+    exact_accumulator accumulator;
+    accumulator.add(values_, n_);
+    return accumulator.result<T>();
+}
+
+#endif
@@ -0,0 +1,124 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+
+#include "benchmark.h"
+#include "accumulator.h"
+#include "random.h"
+
+
+/**
+  * Measures the cost of adding values one at a time, of adding them
+  * as spans, and of merging accumulators, and checks that the
+  * state survives being serialized
+  */
+template <class Algorithm>
+void test_accumulator(const std::string& name_, const std::vector<double>& values_, double exact_) {
+    typedef reduction::accumulator<Algorithm> accumulator_type;
+    const size_t n = values_.size();
+    const size_t bytes = n*sizeof(double);
+    std::cout << name_ << ":" << std::endl;
+
+    double result;
+    const double add_time = run_benchmark("accumulator_add[" + name_ + "]", "double", n, bytes, [&]() {
+        accumulator_type sum;
+        for (size_t i=0; i<n; ++i) {
+            sum.add(values_[i]);
+        }
+        return sum.result();
+    }, result).median;
+    std::cout << "`-> " << std::fixed << std::setprecision(2) << add_time/n*1.0e9 << " ns/add, relative error "
+              << std::scientific << std::setprecision(3) << (result - exact_) / exact_ << std::endl;
+
+    const double span_time = run_benchmark("accumulator_add_span[" + name_ + "]", "double", n, bytes, [&]() {
+        accumulator_type sum;
+        sum.add_span(values_.data(), n);
+        return sum.result();
+    }, result).median;
+    std::cout << "`-> " << std::fixed << std::setprecision(2) << span_time/n*1.0e9 << " ns/value in spans" << std::endl;
+
+    //One accumulator per thousand values, as if each came from its own thread
+    const size_t part = 1000;
+    std::vector<accumulator_type> parts(n / part);
+    for (size_t i=0; i<parts.size(); ++i) {
+        for (size_t j=i*part; j<(i+1)*part; ++j) {
+            parts[i].add(values_[j]);
+        }
+    }
+    const double merge_time = run_benchmark("accumulator_merge[" + name_ + "]", "double", parts.size(), 0, [&]() {
+        accumulator_type sum;
+        for (size_t i=0; i<parts.size(); ++i) {
+            sum.merge(parts[i]);
+        }
+        return sum.result();
+    }, result).median;
+    std::cout << "`-> " << std::fixed << std::setprecision(2) << merge_time/parts.size()*1.0e9 << " ns/merge" << std::endl;
+
+    accumulator_type merged;
+    for (size_t i=0; i<parts.size(); ++i) {
+        merged.merge(parts[i]);
+    }
+    std::vector<unsigned char> buffer(accumulator_type::max_serialized_size);
+    const size_t size = merged.serialize(buffer.data());
+    accumulator_type restored;
+    const bool restored_identical = (restored.deserialize(buffer.data(), size) == size) && (restored.result() == merged.result());
+    std::cout << "`-> Serialized state: " << size << " bytes, restored identically: " << (restored_identical ? "yes" : "no") << std::endl;
+}
+
+int main() {
+    std::vector<double> values(10000000);
+    fill_random(values);
+    const double exact = reduction::reduce<reduction::exact>(values);
+    std::cout << "Exact sum: " << std::fixed << std::setprecision(25) << exact << std::endl;
+
+    test_accumulator<reduction::kahan>("kahan", values, exact);
+    test_accumulator<reduction::neumaier>("neumaier", values, exact);
+    test_accumulator<reduction::exact>("exact", values, exact);
+
+    //The exact sum must not depend on how the values arrive
+    reduction::accumulator<reduction::exact> events, spans, merged;
+    for (size_t i=0; i<values.size(); ++i) {
+        events.add(values[i]);
+    }
+    for (size_t i=0; i<values.size(); i += 4099) {
+        spans.add_span(values.data() + i, std::min<size_t>(4099, values.size() - i));
+    }
+    merged.merge(events);
+    merged.merge(spans);
+    const bool identical = (events.result() == exact) && (spans.result() == exact) && (merged.result() == 2.0*exact);
+    std::cout << "Exact accumulator identical for events, spans and merges: " << (identical ? "yes" : "no") << std::endl;
+
+    benchmark_report().write("test_accumulator");
+}
@@ -0,0 +1,244 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <omp.h>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+
+#include "arena.h"
+#include "benchmark.h"
+#include "random.h"
+#include "reduction.h"
+
+#ifndef _WIN32
+typedef __float128 reference_type;
+#else
+typedef long double reference_type;
+#endif
+
+/**
+  * Accuracy and throughput of one reducer for one type, thread count and input size
+  */
+struct sweep_point {
+    std::string type;
+    std::string algorithm;
+    std::string execution;
+    int threads;
+    size_t elements;
+    double gigabytes_per_second;
+    double relative_error;
+};
+
+/**
+  * Exact sum of n_ floats or doubles, as the sum of the correctly rounded
+  * double and the correctly rounded remainder, which is accurate to
+  * about 106 bits
+  */
+template <typename T>
+reference_type exact_reference(const T* values_, size_t n_) {
+    exact_accumulator sum;
+    sum.add(values_, n_);
+    const double high = sum.result<double>();
+    sum.add(-high);
+    const double low = sum.result<double>();
+    return static_cast<reference_type>(high) + static_cast<reference_type>(low);
+}
+
+/**
+  * Benchmarks one reducer on the first n_ values, and adds its
+  * throughput and relative error against exact_ to points_
+  */
+template <class Algorithm, class Execution, typename T, class Allocator>
+void sweep_reducer(const std::string& algorithm_, const std::string& execution_, const std::string& type_, 
+        const std::vector<T, Allocator>& values_, size_t n_, reference_type exact_, std::vector<sweep_point>& points_) {
+    const T* first = values_.data();
+    const int threads = std::is_same<Execution, reduction::serial>::value ? 1 : omp_get_max_threads();
+    std::stringstream name;
+    name << algorithm_ << "[" << execution_ << "," << threads << " threads," << n_ << "]";
+    T result;
+    const benchmark_result timing = run_benchmark(name.str(), type_, n_, n_*sizeof(T), 
+        [&]() { return reduction::reduce<Algorithm, Execution>(first, first + n_); }, result);
+
+    reference_type error = (static_cast<reference_type>(result) - exact_) / exact_;
+    sweep_point point = { type_, algorithm_, execution_, threads, n_, timing.gigabytes_per_second(), 
+        static_cast<double>((error < 0) ? -error : error) };
+    points_.push_back(point);
+}
+
+/**
+  * Runs every algorithm with the given execution
+  */
+template <class Execution, typename T, class Allocator>
+void sweep_algorithms(const std::string& execution_, const std::string& type_, 
+        const std::vector<T, Allocator>& values_, size_t n_, reference_type exact_, std::vector<sweep_point>& points_) {
+    sweep_reducer<reduction::naive, Execution>("naive", execution_, type_, values_, n_, exact_, points_);
+    sweep_reducer<reduction::pairwise, Execution>("pairwise", execution_, type_, values_, n_, exact_, points_);
+    sweep_reducer<reduction::cascade, Execution>("cascade", execution_, type_, values_, n_, exact_, points_);
+    sweep_reducer<reduction::kahan, Execution>("kahan", execution_, type_, values_, n_, exact_, points_);
+    sweep_reducer<reduction::neumaier, Execution>("neumaier", execution_, type_, values_, n_, exact_, points_);
+    if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value) {
+        sweep_reducer<reduction::exact, Execution>("exact", execution_, type_, values_, n_, exact_, points_);
+    }
+}
+
+/**
+  * Sweeps all reducers, thread counts and input sizes for type T. The input
+  * is the same doubles for every type, rounded for float, so the reference
+  * is the exact sum of the values as stored.
+  */
+template <typename T>
+void sweep_type(const std::string& type_, const std::vector<double>& input_, 
+        const std::vector<size_t>& sizes_, const std::vector<int>& thread_counts_, std::vector<sweep_point>& points_) {
+    std::vector<T, arena_allocator<T> > values(input_.size());
+    for (size_t i=0; i<input_.size(); ++i) {
+        values[i] = static_cast<T>(input_[i]);
+    }
+    const int max_threads = omp_get_max_threads();
+    for (size_t i=0; i<sizes_.size(); ++i) {
+        reference_type exact;
+        if constexpr (std::is_same<T, float>::value) {
+            exact = exact_reference(values.data(), sizes_[i]);
+        }
+        else {
+            exact = exact_reference(input_.data(), sizes_[i]);
+        }
+
+        sweep_algorithms<reduction::serial>("serial", type_, values, sizes_[i], exact, points_);
+        for (size_t j=0; j<thread_counts_.size(); ++j) {
+            omp_set_num_threads(thread_counts_[j]);
+            sweep_algorithms<reduction::openmp>("openmp", type_, values, sizes_[i], exact, points_);
+            sweep_algorithms<reduction::work_stealing>("work_stealing", type_, values, sizes_[i], exact, points_);
+        }
+        omp_set_num_threads(max_threads);
+    }
+}
+
+/**
+  * Keeps the points which no other point beats in both throughput and
+  * error, ordered from the fastest to the most accurate
+  */
+inline std::vector<sweep_point> pareto_front(std::vector<sweep_point> points_) {
+    std::sort(points_.begin(), points_.end(), [](const sweep_point& a_, const sweep_point& b_) {
+        return (a_.gigabytes_per_second != b_.gigabytes_per_second) ? a_.gigabytes_per_second > b_.gigabytes_per_second 
+            : a_.relative_error < b_.relative_error;
+    });
+    std::vector<sweep_point> front;
+    for (size_t i=0; i<points_.size(); ++i) {
+        if (front.empty() || points_[i].relative_error < front.back().relative_error) {
+            front.push_back(points_[i]);
+        }
+    }
+    return front;
+}
+
+int main() {
+    //SWEEP_MAX_ELEMENTS limits the largest input, and SWEEP_DISTRIBUTION chooses the values
+    const size_t max_elements = benchmark_env_setting("SWEEP_MAX_ELEMENTS", 1000000);
+    const char* distribution_setting = getenv("SWEEP_DISTRIBUTION");
+    random_distribution distribution = RANDOM_UNIFORM;
+    if (distribution_setting != NULL && strcmp(distribution_setting, "log-uniform") == 0) {
+        distribution = RANDOM_LOG_UNIFORM;
+    }
+    else if (distribution_setting != NULL && strcmp(distribution_setting, "cancellation") == 0) {
+        distribution = RANDOM_CANCELLATION;
+    }
+
+    std::vector<size_t> sizes;
+    for (size_t n=10000; n<=max_elements; n *= 10) {
+        sizes.push_back(n);
+    }
+    std::vector<int> thread_counts;
+    for (int t=1; t<=omp_get_max_threads(); t *= 2) {
+        thread_counts.push_back(t);
+    }
+    if (thread_counts.back() != omp_get_max_threads()) {
+        thread_counts.push_back(omp_get_max_threads());
+    }
+    if (sizes.empty()) {
+        std::cout << "SWEEP_MAX_ELEMENTS must be at least 10000" << std::endl;
+        return 1;
+    }
+
+    std::vector<double> input(sizes.back());
+    fill_random(input, distribution);
+    std::cout << "Sweeping " << random_distribution_name(distribution) << " values, " << sizes.front() << " to " 
+              << sizes.back() << " elements, 1 to " << thread_counts.back() << " threads" << std::endl;
+
+    std::vector<sweep_point> points;
+    sweep_type<float>("float", input, sizes, thread_counts, points);
+    sweep_type<double>("double", input, sizes, thread_counts, points);
+    sweep_type<long double>("long double", input, sizes, thread_counts, points);
+#ifndef _WIN32
+    sweep_type<__float80>("__float80", input, sizes, thread_counts, points);
+    sweep_type<__float128>("__float128", input, sizes, thread_counts, points);
+#endif
+
+    //The pareto front of each input size, also written next to the benchmark report
+    const char* format = getenv("BENCHMARK_FORMAT");
+    const char* directory = getenv("BENCHMARK_DIR");
+    std::ofstream file;
+    if (format != NULL) {
+        const std::string filename = std::string((directory != NULL) ? directory : ".") + "/test_accuracy_sweep_pareto.csv";
+        file.open(filename.c_str());
+        file << "elements,type,algorithm,execution,threads,gb_per_s,relative_error" << std::endl;
+    }
+    for (size_t i=0; i<sizes.size(); ++i) {
+        std::vector<sweep_point> size_points;
+        for (size_t j=0; j<points.size(); ++j) {
+            if (points[j].elements == sizes[i]) {
+                size_points.push_back(points[j]);
+            }
+        }
+        const std::vector<sweep_point> front = pareto_front(size_points);
+
+        std::cout << std::endl << "Pareto front for " << sizes[i] << " elements (fastest first):" << std::endl;
+        std::cout << std::left << std::setw(14) << "Type" << std::setw(12) << "Algorithm" << std::setw(16) << "Execution" 
+                  << std::right << std::setw(8) << "Threads" << std::setw(10) << "GB/s" << std::setw(16) << "Rel. error" << std::endl;
+        for (size_t j=0; j<front.size(); ++j) {
+            const sweep_point& p = front[j];
+            std::cout << std::left << std::setw(14) << p.type << std::setw(12) << p.algorithm << std::setw(16) << p.execution 
+                      << std::right << std::setw(8) << p.threads << std::fixed << std::setprecision(2) << std::setw(10) << p.gigabytes_per_second 
+                      << std::scientific << std::setprecision(3) << std::setw(16) << p.relative_error << std::endl;
+            if (file.is_open()) {
+                file << p.elements << "," << p.type << "," << p.algorithm << "," << p.execution << "," << p.threads << ","
+                     << p.gigabytes_per_second << "," << p.relative_error << std::endl;
+            }
+        }
+    }
+
+    benchmark_report().write("test_accuracy_sweep");
+}
@@ -0,0 +1,126 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "benchmark.h"
+#include "reduction.h"
+
+
+/**
+  * Sums each array with its own parallel region, as a caller
+  * without the batched API would do
+  */
+template <class Algorithm>
+std::vector<double> sum_each(const std::vector<reduction::span<double> >& arrays_) {
+    std::vector<double> results(arrays_.size());
+    for (size_t i=0; i<arrays_.size(); ++i) {
+        const double* values = arrays_[i].data;
+        results[i] = reduction::reduce<Algorithm, reduction::openmp>(values, values + arrays_[i].size);
+    }
+    return results;
+}
+
+/**
+  * Sum of all the per-array results, so that the benchmarks
+  * have a single value to report
+  */
+inline double total(const std::vector<double>& results_) {
+    double sum = 0.0;
+    for (size_t i=0; i<results_.size(); ++i) {
+        sum += results_[i];
+    }
+    return sum;
+}
+
+int main() {
+    //Many small arrays, and a few large ones which have to be split
+    const size_t small_arrays = 2000;
+    const size_t large_arrays = 5;
+    std::vector<std::vector<double> > data;
+    srand(0); //Make sure that the random numbers are the same for each run
+    for (size_t i=0; i<small_arrays + large_arrays; ++i) {
+        const size_t size = (i < small_arrays) ? 100 + rand() % 4900 : 1000000;
+        std::vector<double> values(size);
+        for (size_t j=0; j<size; ++j) {
+            values[j] = rand() / static_cast<double>(RAND_MAX);
+        }
+        data.push_back(values);
+    }
+    for (size_t i=data.size()-1; i>0; --i) {
+        std::swap(data[i], data[rand() % (i+1)]);
+    }
+
+    std::vector<reduction::span<double> > arrays;
+    size_t elements = 0;
+    for (size_t i=0; i<data.size(); ++i) {
+        arrays.push_back(reduction::span<double>(data[i]));
+        elements += data[i].size();
+    }
+    const size_t bytes = elements*sizeof(double);
+
+    omp_set_num_threads(10);
+    std::cout << arrays.size() << " arrays, " << elements << " elements in total" << std::endl;
+
+    //The reproducible sums must not depend on how the arrays are batched
+    const bool pairwise_identical = (reduction::reduce_batch<reduction::pairwise>(arrays) == sum_each<reduction::pairwise>(arrays));
+    const bool exact_identical = (reduction::reduce_batch<reduction::exact>(arrays) == sum_each<reduction::exact>(arrays));
+    std::cout << "Batched pairwise sums identical: " << (pairwise_identical ? "yes" : "no") << std::endl;
+    std::cout << "Batched exact sums identical: " << (exact_identical ? "yes" : "no") << std::endl;
+
+    const std::vector<double> exact = reduction::reduce_batch<reduction::exact>(arrays);
+    const std::vector<double> kahan = reduction::reduce_batch<reduction::kahan>(arrays);
+    double max_error = 0.0;
+    for (size_t i=0; i<arrays.size(); ++i) {
+        max_error = std::max(max_error, std::abs(kahan[i] - exact[i]) / std::abs(exact[i]));
+    }
+    std::cout << "Batched Kahan sums, max relative error: " << std::scientific << max_error << std::endl;
+
+    double result;
+    const double loop_sum = run_benchmark("loop_parallel_sum", "double", elements, bytes,
+        [&]() { return total(sum_each<reduction::naive>(arrays)); }, result).median;
+    const double batch_sum = run_benchmark("batch_sum", "double", elements, bytes,
+        [&]() { return total(reduction::reduce_batch<reduction::naive>(arrays)); }, result).median;
+    const double loop_kahan = run_benchmark("loop_kahan_sum", "double", elements, bytes,
+        [&]() { return total(sum_each<reduction::kahan>(arrays)); }, result).median;
+    const double batch_kahan = run_benchmark("batch_kahan_sum", "double", elements, bytes,
+        [&]() { return total(reduction::reduce_batch<reduction::kahan>(arrays)); }, result).median;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Speedup of batching, naive sum: " << loop_sum / batch_sum << std::endl;
+    std::cout << "Speedup of batching, Kahan sum: " << loop_kahan / batch_kahan << std::endl;
+
+    benchmark_report().write("test_batched_summation");
+}
@@ -0,0 +1,132 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+#include <vector>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <sstream>
+
+#include "benchmark.h"
+#include "fp_environment.h"
+#include "numa.h"
+#include "perf_counters.h"
+#include "reduction.h"
+
+/**
+  * Fills values_ with small numbers where about fraction_ of them are
+  * subnormal, and the rest are normal numbers in [min, 1024*min). The sums
+  * stay normal, but the rounding errors tracked by Kahan summation do not.
+  */
+template <typename T, class Allocator>
+void fill_subnormals(std::vector<T, Allocator>& values_, double fraction_) {
+    srand(0); //Make sure that the random numbers are the same for each run
+    const T min = std::numeric_limits<T>::min();
+    for (size_t i=0; i<values_.size(); ++i) {
+        const bool subnormal = (rand() / static_cast<double>(RAND_MAX)) < fraction_;
+        const T r = rand() / static_cast<T>(RAND_MAX);
+        values_[i] = subnormal ? r*min : min + r*1023*min;
+    }
+}
+
+/**
+  * Benchmarks one kernel with and without flushing denormals, and prints
+  * the slowdown against the same kernel on input without subnormals
+  */
+template <typename T, class F>
+void test_kernel(const std::string& name_, const std::string& type_, double fraction_, size_t n_, 
+                 double exact_, bool parallel_, F f_, std::vector<double>& baseline_, size_t kernel_) {
+    const size_t bytes = n_*sizeof(T);
+    std::ostringstream label;
+    label << name_ << "[subnormal=" << fraction_*100 << "%]";
+
+    T result, flushed_result;
+    const benchmark_result timing = run_benchmark(label.str(), type_, n_, bytes, f_, result);
+    print_perf_counters(bytes, parallel_, f_, result);
+    double flushed_time;
+    {
+        flush_denormals_scope flush;
+        flushed_time = run_benchmark(label.str() + "[ftz]", type_, n_, bytes, f_, flushed_result).median;
+        print_perf_counters(bytes, parallel_, f_, flushed_result);
+    }
+
+    if (fraction_ == 0.0) {
+        baseline_[kernel_] = timing.median;
+    }
+    std::cout << std::setprecision(2) << std::fixed
+              << name_ << ": slowdown " << timing.median / baseline_[kernel_] << "x, with FTZ/DAZ "
+              << flushed_time / baseline_[kernel_] << "x" << std::scientific << std::setprecision(3)
+              << ", relative error " << (result - exact_) / exact_ 
+              << ", with FTZ/DAZ " << (flushed_result - exact_) / exact_ << std::endl;
+}
+
+template <typename T>
+void perform_test(const std::string& type_) {
+    const size_t n = 10000000;
+    const double fractions[] = { 0.0, 0.01, 0.1, 0.5, 1.0 };
+    std::vector<T, first_touch_allocator<T> > values(n);
+    std::vector<double> baseline(3);
+
+    std::cout << "Floating point bits=" << sizeof(T)*8 << ", smallest normal " 
+              << std::scientific << std::numeric_limits<T>::min() << std::endl;
+    for (int i=0; i<5; ++i) {
+        fill_subnormals(values, fractions[i]);
+        const double exact = reduction::reduce<reduction::exact, reduction::openmp, double>(values);
+        std::cout << "Subnormals " << std::fixed << std::setprecision(0) << fractions[i]*100 << "%, exact sum " 
+                  << std::scientific << std::setprecision(17) << exact << std::endl;
+
+        test_kernel<T>("sum", type_, fractions[i], n, exact, false, 
+            [&]() { return reduction::reduce<reduction::naive>(values); }, baseline, 0);
+        test_kernel<T>("serial_kahan_sum", type_, fractions[i], n, exact, false, 
+            [&]() { return reduction::reduce<reduction::kahan>(values); }, baseline, 1);
+        test_kernel<T>("kahan_sum", type_, fractions[i], n, exact, true, 
+            [&]() { return reduction::reduce<reduction::kahan, reduction::openmp>(values); }, baseline, 2);
+    }
+}
+
+
+int main() {
+    omp_set_num_threads(10);
+    if (!flush_denormals_supported()) {
+        std::cout << "Flushing denormals is not supported on this platform" << std::endl;
+    }
+
+    std::cout << "Float:" << std::endl;
+    perform_test<float>("float");
+    std::cout << std::endl;
+
+    std::cout << "Double:" << std::endl;
+    perform_test<double>("double");
+    std::cout << std::endl;
+
+    benchmark_report().write("test_denormal_summation");
+}
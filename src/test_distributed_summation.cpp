@@ -0,0 +1,109 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+#include <vector>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#include "benchmark.h"
+#include "distributed.h"
+#include "random.h"
+
+
+int main(int argc, char** argv) {
+    if (reduction::serve_if_worker<double>(argc, argv)) {
+        return 0;
+    }
+
+    const int max_workers = 4;
+    reduction::shared_array<double> values(10000000);
+    fill_random(values.data(), values.size());
+    const size_t bytes = values.size()*sizeof(double);
+    const double* first = values.data();
+    const double* last = first + values.size();
+
+    std::cout << "One process, " << omp_get_max_threads() << " threads:" << std::endl << std::fixed << std::setprecision(25);
+    const double exact = reduction::reduce<reduction::exact, reduction::openmp>(first, last);
+    const double reproducible = reduction::reduce<reduction::pairwise, reduction::openmp>(first, last);
+    std::cout << "`-> Exact sum: " << exact << ", reproducible sum: " << reproducible << std::endl;
+
+    double result;
+    std::vector<std::vector<double> > times;
+    std::vector<double> medians;
+    medians.push_back(run_benchmark("kahan_sum", "double", values.size(), bytes, 
+        [&]() { return reduction::reduce<reduction::kahan, reduction::openmp>(first, last); }, result).median);
+    medians.push_back(run_benchmark("exact_sum", "double", values.size(), bytes, 
+        [&]() { return reduction::reduce<reduction::exact, reduction::openmp>(first, last); }, result).median);
+    times.push_back(medians);
+
+    //The cores are shared between the workers, so that the speedup shows
+    //the cost of distributing the work and not of oversubscribing the cores
+    bool all_identical = true;
+    std::vector<int> worker_threads;
+    for (int i=1; i<=max_workers; ++i) {
+        const int threads = std::max(1, omp_get_max_threads()/i);
+        worker_threads.push_back(threads);
+        reduction::process_group<double> workers(values, i, threads);
+        std::cout << i << " worker processes, " << threads << " threads each:" << std::endl;
+
+        const double distributed_exact = workers.reduce<reduction::exact>();
+        const double distributed_reproducible = workers.reduce<reduction::pairwise>();
+        const double distributed_kahan = workers.reduce<reduction::kahan>();
+        all_identical = all_identical && (distributed_exact == exact) && (distributed_reproducible == reproducible);
+        std::cout << std::fixed << std::setprecision(25) << "`-> Exact sum: " << distributed_exact 
+                  << ", reproducible sum: " << distributed_reproducible << ", Kahan sum: " << distributed_kahan << std::endl;
+
+        std::stringstream suffix;
+        suffix << "[" << i << " workers]";
+        medians.clear();
+        medians.push_back(run_benchmark("distributed_kahan_sum" + suffix.str(), "double", values.size(), bytes, 
+            [&]() { return workers.reduce<reduction::kahan>(); }, result).median);
+        medians.push_back(run_benchmark("distributed_exact_sum" + suffix.str(), "double", values.size(), bytes, 
+            [&]() { return workers.reduce<reduction::exact>(); }, result).median);
+        times.push_back(medians);
+    }
+    std::cout << "Exact and reproducible sums identical for all worker counts: " << (all_identical ? "yes" : "no") << std::endl;
+
+    std::cout << "Speedup over one process:" << std::endl << std::setw(8) << "Workers" << std::setw(10) << "Threads"
+              << std::setw(16) << "kahan" << std::setw(16) << "exact" << std::endl << std::fixed << std::setprecision(2);
+    for (size_t i=1; i<times.size(); ++i) {
+        std::cout << std::setw(8) << i << std::setw(10) << worker_threads[i-1];
+        for (size_t j=0; j<times[i].size(); ++j) {
+            std::cout << std::setw(16) << times[0][j] / times[i][j];
+        }
+        std::cout << std::endl;
+    }
+
+    benchmark_report().write("test_distributed_summation");
+}
@@ -29,42 +29,19 @@
 
 #include <iostream>
 #include <iomanip>
+#include <string>
 
-#ifdef _WIN32
-#include <Windows.h>
-#else
-#include <time.h>
-#include <unistd.h>
-#endif
+#include "benchmark.h"
+#include "double_double.h"
+#include "reduction.h"
 
 /**
-  * Returns current time in milliseconds
+  * Computes the sum of ten million value_'s with the given algorithm
   */
-unsigned long long getCurrentTimeMS() {
-#ifdef _WIN32
-    LARGE_INTEGER f;
-    LARGE_INTEGER t;
-    QueryPerformanceFrequency(&f);
-    QueryPerformanceCounter(&t);
-    return static_cast<unsigned long long>(t.QuadPart * 1e6/(double) f.QuadPart);
-#else
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    return static_cast<unsigned long long>(ts.tv_sec*1e6+ts.tv_nsec/1e3);
-#endif
-}
-
-/**
-  * Computes the sum of ten million value_'s
-  */
-template<typename T>
+template<class Algorithm, typename T>
 T sum_ten_million(const T& value_) {
-    unsigned int iterations = 10000000;
-    T result = 0.0;
-    for (unsigned int i = 0; i<iterations; ++i) {
-        result += value_;
-    }
-    return result;
+    const reduction::repeat_iterator<T> first(value_, 0);
+    return reduction::reduce<Algorithm>(first, first + 10000000);
 }
 
 #ifndef _WIN32
@@ -79,47 +56,67 @@ std::ostream& operator<< (std::ostream& out, __float128 val) {
     for (int i=0; i<128; i+=8*sizeof(unsigned int)) {
         out << std::hex << std::setfill('0') << std::setw(2*sizeof(unsigned int)) << buff[i] << " ";
     }
-    out << ")";
+    out << std::dec << ")";
     return out;
 }
 #endif
 
 template <typename T>
-void perform_test(const T& value_) {
-    unsigned long long start = getCurrentTimeMS();
-    T result = sum_ten_million(value_);
-    unsigned long long end = getCurrentTimeMS();
+benchmark_result perform_test(const T& value_, const std::string& type_) {
+    T result;
     std::cout << "Floating point bits=" << sizeof(T)*8 << std::endl;
+    benchmark_result timing = run_benchmark("sum_ten_million", type_, 10000000, 0, [&]() { return sum_ten_million<reduction::naive>(value_); }, result);
     std::cout << std::fixed << std::setprecision(50) << result << std::setprecision(-1) << std::endl;
-    std::cout << "Completed in " << (end-start) / 1.0e6 << " s." << std::endl;
+    run_benchmark("cascade_sum_ten_million", type_, 10000000, 0, [&]() { return sum_ten_million<reduction::cascade>(value_); }, result);
+    std::cout << std::fixed << std::setprecision(50) << result << std::setprecision(-1) << std::endl;
+    return timing;
 }
 
 
 int main() {
     float value_f = 0.1f;
     std::cout << "float:" << std::endl;
-    perform_test(value_f);
+    perform_test(value_f, "float");
     std::cout << std::endl;
     
     double value_d = 0.1;
     std::cout << "double:" << std::endl;
-    perform_test(value_d);
+    perform_test(value_d, "double");
     std::cout << std::endl;
 
     long double value_ld = 0.1;
     std::cout << "long double:" << std::endl;
-    perform_test(value_ld);
+    perform_test(value_ld, "long double");
     std::cout << std::endl;
 
 #ifndef _WIN32
     __float80 value_80 = 0.1w;
     std::cout << "__float80:" << std::endl;
-    perform_test(value_80);
+    perform_test(value_80, "__float80");
     std::cout << std::endl;
 
     __float128 value_128 = 0.1q;
     std::cout << "__float128:" << std::endl;
-    perform_test(value_128);
+    benchmark_result timing_128 = perform_test(value_128, "__float128");
     std::cout << std::endl;
 #endif
+
+    double_double value_dd = double_double(1.0) / double_double(10.0);
+    std::cout << "double-double:" << std::endl;
+    benchmark_result timing_dd = perform_test(value_dd, "double-double");
+    std::cout << std::endl;
+
+    quad_double value_qd = quad_double(1.0) / quad_double(10.0);
+    std::cout << "quad-double:" << std::endl;
+    benchmark_result timing_qd = perform_test(value_qd, "quad-double");
+    std::cout << std::endl;
+
+#ifndef _WIN32
+    std::cout << "Time relative to __float128:" << std::endl;
+    std::cout << "double-double: " << timing_dd.median / timing_128.median << std::endl;
+    std::cout << "quad-double:   " << timing_qd.median / timing_128.median << std::endl;
+    std::cout << std::endl;
+#endif
+
+    benchmark_report().write("test_float_summation");
 }
@@ -0,0 +1,202 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "benchmark.h"
+#include "perf_counters.h"
+#include "random.h"
+#include "reduction.h"
+#include "statistics.h"
+
+/**
+  * The same statistics with one parallel pass over the memory for
+  * each of them: the Kahan sum, the squared deviations from the
+  * mean, the min and the max
+  */
+template <typename A, typename T>
+reduction::statistics<A> separate_passes(const std::vector<T>& values_) {
+    const long n = values_.size();
+    reduction::statistics<A> result;
+    result.count = n;
+    result.sum = compensated<A>(reduction::reduce<reduction::kahan, reduction::openmp, A>(values_), 0.0);
+
+    const A mean = result.mean();
+    A squares = 0.0;
+    #pragma omp parallel for reduction(+:squares)
+    for (long i=0; i<n; ++i) {
+        const A d = static_cast<A>(values_[i]) - mean;
+        squares += d*d;
+    }
+    result.squares = squares;
+
+    A min = std::numeric_limits<A>::infinity();
+    #pragma omp parallel for reduction(min:min)
+    for (long i=0; i<n; ++i) {
+        min = std::min(min, static_cast<A>(values_[i]));
+    }
+    result.min = min;
+
+    A max = -std::numeric_limits<A>::infinity();
+    #pragma omp parallel for reduction(max:max)
+    for (long i=0; i<n; ++i) {
+        max = std::max(max, static_cast<A>(values_[i]));
+    }
+    result.max = max;
+    return result;
+}
+
+/**
+  * Single pass with the textbook formula, variance = (sum of squares - sum^2/n) / n,
+  * which cancels catastrophically when the mean is large compared to the spread
+  */
+template <typename A, typename T>
+reduction::statistics<A> textbook_one_pass(const std::vector<T>& values_) {
+    const long n = values_.size();
+    A sum = 0.0;
+    A sum_squares = 0.0;
+    #pragma omp parallel for reduction(+:sum, sum_squares)
+    for (long i=0; i<n; ++i) {
+        const A x = static_cast<A>(values_[i]);
+        sum += x;
+        sum_squares += x*x;
+    }
+    reduction::statistics<A> result;
+    result.count = n;
+    result.sum = compensated<A>(sum, 0.0);
+    result.squares = sum_squares - sum*sum/n;
+    return result;
+}
+
+inline double relative_error(double value_, long double reference_) {
+    return static_cast<double>(std::abs((value_ - reference_) / reference_));
+}
+
+template <typename A>
+void print_errors(const std::string& name_, const reduction::statistics<A>& statistics_, long double mean_, long double variance_) {
+    std::cout << std::setw(20) << std::left << name_ << std::right << std::scientific << std::setprecision(2)
+              << " mean error " << relative_error(statistics_.mean(), mean_)
+              << ", variance error " << relative_error(statistics_.variance(), variance_) << std::endl;
+}
+
+template <typename A>
+bool identical(const reduction::statistics<A>& a_, const reduction::statistics<A>& b_) {
+    return a_.count == b_.count && a_.sum.sum == b_.sum.sum && a_.sum.error == b_.sum.error
+        && a_.squares == b_.squares && a_.min == b_.min && a_.max == b_.max;
+}
+
+/**
+  * Ten million values with a mean of about 1000 and a variance
+  * of about 1/12, stored as T and summarized in A
+  */
+template <typename T, typename A>
+void test_statistics(const std::string& type_) {
+    const size_t n = 10000000;
+    std::vector<T> values(n);
+    fill_random(values);
+    #pragma omp parallel for
+    for (long i=0; i<static_cast<long>(n); ++i) {
+        values[i] += T(1000.0);
+    }
+
+    //Two passes in long double, with the mean from the correctly rounded sum
+    const long double mean = static_cast<long double>(reduction::reduce<reduction::exact, reduction::serial, double>(values)) / n;
+    long double squares = 0.0L;
+    long double error = 0.0L;
+    for (size_t i=0; i<n; ++i) {
+        const long double d = values[i] - mean;
+        const long double y = d*d + error;
+        const long double t = squares + y;
+        error = y - (t - squares);
+        squares = t;
+    }
+    const long double variance = squares / n;
+    const std::pair<typename std::vector<T>::iterator, typename std::vector<T>::iterator> extremes
+        = std::minmax_element(values.begin(), values.end());
+
+    std::cout << "=== " << type_ << " ===" << std::endl;
+    std::cout << "Mean " << std::fixed << std::setprecision(15) << static_cast<double>(mean)
+              << ", variance " << static_cast<double>(variance) << std::endl;
+
+    //The lanes make the fused kernel give the same result for every instruction set
+    const simd_level supported = get_simd_level();
+    set_simd_level(SIMD_SCALAR);
+    const reduction::statistics<A> scalar = reduction::compute_statistics<reduction::serial, A>(values);
+    bool same = true;
+    for (int level=SIMD_SSE2; level<=supported; ++level) {
+        set_simd_level(static_cast<simd_level>(level));
+        same = same && identical(scalar, reduction::compute_statistics<reduction::serial, A>(values));
+    }
+    set_simd_level(supported);
+    std::cout << "Fused statistics identical for all instruction sets: " << (same ? "yes" : "no") << std::endl;
+
+    const reduction::statistics<A> fused = reduction::compute_statistics<reduction::openmp, A>(values);
+    std::cout << "Min and max match std::minmax_element: "
+              << ((fused.min == *extremes.first && fused.max == *extremes.second) ? "yes" : "no") << std::endl;
+    print_errors("Fused", fused, mean, variance);
+    print_errors("Separate passes", separate_passes<A>(values), mean, variance);
+    print_errors("Textbook one pass", textbook_one_pass<A>(values), mean, variance);
+
+    const size_t bytes = n*sizeof(T);
+    for (int level=SIMD_SCALAR; level<=supported; ++level) {
+        set_simd_level(static_cast<simd_level>(level));
+        const std::string name = simd_level_name(get_simd_level());
+        reduction::statistics<A> result;
+        run_benchmark("serial_fused_statistics[" + name + "]", type_, n, bytes,
+            [&]() { return reduction::compute_statistics<reduction::serial, A>(values); }, result);
+    }
+    set_simd_level(supported);
+
+    reduction::statistics<A> result;
+    const double fused_time = run_benchmark("fused_statistics", type_, n, bytes,
+        [&]() { return reduction::compute_statistics<reduction::openmp, A>(values); }, result).median;
+    print_perf_counters(bytes, true, [&]() { return reduction::compute_statistics<reduction::openmp, A>(values); }, result);
+    const double separate_time = run_benchmark("separate_passes", type_, n, 4*bytes,
+        [&]() { return separate_passes<A>(values); }, result).median;
+    print_perf_counters(4*bytes, true, [&]() { return separate_passes<A>(values); }, result);
+    run_benchmark("textbook_one_pass", type_, n, bytes, [&]() { return textbook_one_pass<A>(values); }, result);
+
+    std::cout << "Speedup of the fused pass over separate passes: " << std::fixed << std::setprecision(2)
+              << separate_time / fused_time << std::endl;
+}
+
+int main() {
+    test_statistics<double, double>("double");
+    test_statistics<float, double>("float in double");
+    test_statistics<float, float>("float");
+
+    benchmark_report().write("test_fused_statistics");
+}
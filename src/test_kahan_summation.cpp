@@ -32,86 +32,291 @@
 #include <omp.h>
 #include <vector>
 #include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <string>
 
+#include "arena.h"
+#include "benchmark.h"
+#include "compensated_summation.h"
+#include "double_double.h"
+#include "numa.h"
+#include "perf_counters.h"
+#include "random.h"
+#include "reduction.h"
 
-template<typename T>
-T kahan_sum(const std::vector<T>& values_) {
-    T result = 0.0;
-    #pragma omp parallel
-    {
-        T thread_result = 0.0;
-        T compensation = 0.0;
-        #pragma omp for schedule(dynamic, 50)
-        for (int i = 0; i<values_.size(); ++i) {
-            T value = values_[i] - compensation;
-            T sum = thread_result + value;
-            compensation = (sum - thread_result) - value;
-            thread_result = sum;
+/**
+  * Measures the read bandwidth of each socket, where every thread
+  * streams through its own static partition of the values. The time
+  * of a socket is from its first thread starts until its last finishes.
+  */
+template <typename T, class Allocator>
+void report_socket_bandwidth(const std::vector<T, Allocator>& values_) {
+    const int repetitions = 5;
+    const int max_threads = omp_get_max_threads();
+    std::vector<double> starts(max_threads), ends(max_threads);
+    std::vector<size_t> bytes(max_threads, 0);
+    std::vector<int> sockets(max_threads, -1);
+    std::vector<reduction::thread_partial<T> > partials(max_threads);
+    std::map<int, double> socket_times;
+
+    for (int i=0; i<repetitions; ++i) {
+        #pragma omp parallel
+        {
+            const int thread = omp_get_thread_num();
+            size_t begin, end;
+            static_partition(values_.size(), thread, omp_get_num_threads(), begin, end);
+            sockets[thread] = socket_of_cpu(current_cpu());
+            bytes[thread] = (end-begin)*sizeof(T);
+            #pragma omp barrier
+            starts[thread] = omp_get_wtime();
+            partials[thread].value = kahan_sum_simd(values_.data()+begin, end-begin);
+            ends[thread] = omp_get_wtime();
+        }
+
+        std::map<int, std::pair<double, double> > spans;
+        for (int j=0; j<max_threads; ++j) {
+            if (sockets[j] < 0) continue;
+            if (spans.count(sockets[j]) == 0) {
+                spans[sockets[j]] = std::make_pair(starts[j], ends[j]);
+            }
+            std::pair<double, double>& span = spans[sockets[j]];
+            span.first = std::min(span.first, starts[j]);
+            span.second = std::max(span.second, ends[j]);
+        }
+        for (std::map<int, std::pair<double, double> >::const_iterator it = spans.begin(); it != spans.end(); ++it) {
+            const double time = it->second.second - it->second.first;
+            if (socket_times.count(it->first) == 0 || time < socket_times[it->first]) {
+                socket_times[it->first] = time;
+            }
         }
-        #pragma omp critical
-        result = result + thread_result;
     }
-    return result;
-}
 
-template <typename T>
-T parallel_sum(const std::vector<T>& values_) {
-    T result = 0.0;
-    #pragma omp parallel for schedule(dynamic, 50) reduction(+:result)
-    for (int i = 0; i<values_.size(); ++i) {
-        result = result + values_[i];
+    for (std::map<int, double>::const_iterator it = socket_times.begin(); it != socket_times.end(); ++it) {
+        size_t socket_bytes = 0;
+        for (int j=0; j<max_threads; ++j) {
+            socket_bytes += (sockets[j] == it->first) ? bytes[j] : 0;
+        }
+        std::cout << "Socket " << it->first << " bandwidth: " << std::setprecision(2) 
+                  << socket_bytes / it->second * 1.0e-9 << " GB/s" << std::setprecision(40) << std::endl;
     }
-    return result;
 }
 
-template <typename T>
-T sum(const std::vector<T>& values_) {
-    T result = 0.0;
-    for (unsigned int i = 0; i<values_.size(); ++i) {
-        result = result + values_[i];
+/**
+  * Benchmarks the correctly rounded sum, and checks that it is the
+  * same for the values in reverse order and for any number of threads
+  */
+template <typename T, class Allocator>
+void test_exact_sum(const std::vector<T, Allocator>& values_, const std::string& type_) {
+    const size_t n = values_.size();
+    const size_t bytes = n*sizeof(T);
+    T result;
+    run_benchmark("exact_sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::exact, reduction::openmp>(values_); }, result);
+    print_perf_counters(bytes, true, [&]() { return reduction::reduce<reduction::exact, reduction::openmp>(values_); }, result);
+
+    std::vector<T, Allocator> reversed(values_.rbegin(), values_.rend());
+    bool identical = (reduction::reduce<reduction::exact, reduction::openmp>(reversed) == result);
+    const int max_threads = omp_get_max_threads();
+    for (int i=1; i<=max_threads; ++i) {
+        omp_set_num_threads(i);
+        identical = identical && (reduction::reduce<reduction::exact, reduction::openmp>(values_) == result);
     }
-    return result;
+    omp_set_num_threads(max_threads);
+    std::cout << "Exact sum " << std::fixed << std::setprecision(40) << result 
+              << ", identical for reversed values and 1-" << max_threads << " threads: " 
+              << (identical ? "yes" : "no") << std::endl;
 }
 
-template <typename T>
-void perform_test() {
-    std::vector<T> values(10000000);
-    srand(0); //Make sure that the random numbers are the same for each run
+template <class Allocator>
+void test_exact_sum(const std::vector<long double, Allocator>&, const std::string&) {
+    std::cout << "Exact sum is only supported for float and double" << std::endl;
+}
+
+/**
+  * Prints the relative error of the parallel naive, cascade and Kahan sums
+  * against the exact sum, to compare how hard the input distributions are
+  */
+template <typename T, class Allocator>
+void print_distribution_errors(const std::vector<T, Allocator>& values_, const std::string& distribution_) {
+    const double exact = reduction::reduce<reduction::exact, reduction::openmp, double>(values_);
+    const double naive = reduction::reduce<reduction::naive, reduction::openmp>(values_);
+    const double cascade = reduction::reduce<reduction::cascade, reduction::openmp>(values_);
+    const double kahan = reduction::reduce<reduction::kahan, reduction::openmp>(values_);
+    std::cout << "Relative error for " << distribution_ << " values: " << std::scientific << std::setprecision(3)
+              << "sum " << (naive - exact) / exact << ", cascade sum " << (cascade - exact) / exact 
+              << ", Kahan sum " << (kahan - exact) / exact << std::fixed << std::setprecision(40) << std::endl;
+}
+
+template <class Allocator>
+void print_distribution_errors(const std::vector<long double, Allocator>&, const std::string&) {}
+
+/**
+  * Benchmarks the input generator, and checks that it gives the same
+  * values with one thread and no vectorization as with all threads and
+  * the widest vectors. Leaves uniform values in values_.
+  */
+template <typename T, class Allocator>
+void test_input_generation(std::vector<T, Allocator>& values_, const std::string& type_) {
+    const size_t n = values_.size();
+    const size_t bytes = n*sizeof(T);
+    const int max_threads = omp_get_max_threads();
+    const simd_level supported = get_simd_level();
+    std::vector<T, Allocator> serial(n);
+    const random_distribution distributions[3] = { RANDOM_UNIFORM, RANDOM_LOG_UNIFORM, RANDOM_CANCELLATION };
+    for (int i=2; i>=0; --i) {
+        const std::string name = random_distribution_name(distributions[i]);
+        T last;
+        run_benchmark("fill_random[" + name + "]", type_, n, bytes, 
+            [&]() { fill_random(values_, distributions[i]); return values_[n-1]; }, last);
 
-    for (unsigned int i=0; i<values.size(); ++i) {
-        values[i] = rand() / static_cast<T>(RAND_MAX);
+        omp_set_num_threads(1);
+        set_simd_level(SIMD_SCALAR);
+        fill_random(serial, distributions[i]);
+        omp_set_num_threads(max_threads);
+        set_simd_level(supported);
+        std::cout << "Identical " << name << " values for 1 thread without vectorization: " 
+                  << (std::equal(serial.begin(), serial.end(), values_.begin()) ? "yes" : "no") << std::endl;
+        print_distribution_errors(values_, name);
     }
+}
 
-    const unsigned int iterations = 15;
+/**
+  * Prints the error of result_ against the exact sum, which
+  * is kept as a double-double so that double sums can be compared
+  */
+inline void print_error(const std::string& name_, const double_double& result_, const double_double& exact_) {
+    const double error = (result_ - exact_).to_double();
+    std::cout << name_ << " error vs exact: " << std::scientific << std::setprecision(3) << error 
+              << " (relative " << error / exact_.to_double() << ")" << std::fixed << std::setprecision(40) << std::endl;
+}
+
+/**
+  * Mixed precision: Values stored as float to halve the memory traffic,
+  * and summed in double or double-double precision for accuracy
+  */
+template <typename T, class Allocator>
+void test_mixed_precision(const std::vector<T, Allocator>&, const std::string&) {}
+
+template <class Allocator>
+void test_mixed_precision(const std::vector<float, Allocator>& values_, const std::string& type_) {
+    const size_t n = values_.size();
+    const size_t bytes = n*sizeof(float);
+
+    exact_accumulator accumulator;
+    accumulator.add(values_.data(), n);
+    const double exact_hi = accumulator.result<double>();
+    accumulator.add(-exact_hi);
+    const double_double exact(exact_hi, accumulator.result<double>());
+
+    double double_result;
+    double_double double_double_result;
+    print_error("Float sum", reduction::reduce<reduction::naive>(values_), exact);
+    print_error("Float Kahan sum", reduction::reduce<reduction::kahan>(values_), exact);
+    run_benchmark("sum[float->double]", type_, n, bytes, 
+        [&]() { return reduction::reduce<reduction::naive, reduction::serial, double>(values_); }, double_result);
+    print_error("Float to double sum", double_result, exact);
+    run_benchmark("serial_kahan_sum[float->double]", type_, n, bytes, 
+        [&]() { return reduction::reduce<reduction::kahan, reduction::serial, double>(values_); }, double_result);
+    print_error("Float to double Kahan sum", double_result, exact);
+    run_benchmark("sum[float->double-double]", type_, n, bytes, 
+        [&]() { return reduction::reduce<reduction::naive, reduction::serial, double_double>(values_); }, double_double_result);
+    print_error("Float to double-double sum", double_double_result, exact);
+    run_benchmark("parallel_sum[float->double]", type_, n, bytes, 
+        [&]() { return reduction::reduce<reduction::naive, reduction::openmp, double>(values_); }, double_result);
+    print_error("Parallel float to double sum", double_result, exact);
+    run_benchmark("kahan_sum[float->double]", type_, n, bytes, 
+        [&]() { return reduction::reduce<reduction::kahan, reduction::openmp, double>(values_); }, double_result);
+    print_error("Parallel float to double Kahan sum", double_result, exact);
+}
+
+template <typename T>
+void perform_test(const std::string& type_) {
+    std::vector<T, arena_allocator<T> > values(10000000);
     std::cout << "Floating point bits=" << sizeof(T)*8 << std::endl;
-    std::cout << "Serial sum " << sum(values) << std::endl;
-    std::cout << "Parallel sum, Kahan sum" << std::endl;
+    test_input_generation(values, type_);
+
+    const unsigned int iterations = 15;
+    const size_t n = values.size();
+    const size_t bytes = n*sizeof(T);
+    T serial_result;
+    run_benchmark("sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::naive>(values); }, serial_result);
+    print_perf_counters(bytes, false, [&]() { return reduction::reduce<reduction::naive>(values); }, serial_result);
+    std::cout << "Serial sum " << std::fixed << std::setprecision(40) << serial_result << std::endl;
+    T cascade_result;
+    run_benchmark("cascade_sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::cascade>(values); }, cascade_result);
+    print_perf_counters(bytes, false, [&]() { return reduction::reduce<reduction::cascade>(values); }, cascade_result);
+    std::cout << "Serial cascade sum " << std::fixed << std::setprecision(40) << cascade_result << std::endl;
+
+    //Only float and double have vectorized kernels
+    const simd_level supported = (sizeof(T) <= sizeof(double)) ? get_simd_level() : SIMD_SCALAR;
+    for (int level=SIMD_SCALAR; level<=supported; ++level) {
+        set_simd_level(static_cast<simd_level>(level));
+        const std::string name = simd_level_name(get_simd_level());
+        T kahan_result, neumaier_result;
+        run_benchmark("serial_kahan_sum[" + name + "]", type_, n, bytes, [&]() { return reduction::reduce<reduction::kahan>(values); }, kahan_result);
+        print_perf_counters(bytes, false, [&]() { return reduction::reduce<reduction::kahan>(values); }, kahan_result);
+        run_benchmark("serial_neumaier_sum[" + name + "]", type_, n, bytes, [&]() { return reduction::reduce<reduction::neumaier>(values); }, neumaier_result);
+        print_perf_counters(bytes, false, [&]() { return reduction::reduce<reduction::neumaier>(values); }, neumaier_result);
+        std::cout << "Serial Kahan sum (" << name << ") " << std::setprecision(40) << kahan_result << std::endl;
+        std::cout << "Serial Neumaier sum (" << name << ") " << std::setprecision(40) << neumaier_result << std::endl;
+    }
+    set_simd_level(supported);
+    report_socket_bandwidth(values);
+    std::cout << "Parallel sum, Kahan sum, Reproducible sum" << std::endl;
     for (unsigned int i=0; i<iterations; ++i) {
-        T parallel_result = parallel_sum(values);
-        T kahan_result = kahan_sum(values);
+        T parallel_result = reduction::reduce<reduction::naive, reduction::openmp>(values);
+        T kahan_result = reduction::reduce<reduction::kahan, reduction::openmp>(values);
+        T reproducible_result = reduction::reduce<reduction::pairwise, reduction::openmp>(values);
         std::cout << "Run " << i << ": ";
         std::cout << std::fixed << std::setprecision(40) << parallel_result << ", " 
-                  << std::fixed << std::setprecision(40) << kahan_result << std::endl;
+                  << std::fixed << std::setprecision(40) << kahan_result << ", "
+                  << std::fixed << std::setprecision(40) << reproducible_result << std::endl;
     }
+
+    T result;
+    run_benchmark("parallel_sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::naive, reduction::openmp>(values); }, result);
+    print_perf_counters(bytes, true, [&]() { return reduction::reduce<reduction::naive, reduction::openmp>(values); }, result);
+    run_benchmark("kahan_sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::kahan, reduction::openmp>(values); }, result);
+    print_perf_counters(bytes, true, [&]() { return reduction::reduce<reduction::kahan, reduction::openmp>(values); }, result);
+    run_benchmark("reproducible_sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::pairwise, reduction::openmp>(values); }, result);
+    print_perf_counters(bytes, true, [&]() { return reduction::reduce<reduction::pairwise, reduction::openmp>(values); }, result);
+    run_benchmark("parallel_cascade_sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::cascade, reduction::openmp>(values); }, result);
+    print_perf_counters(bytes, true, [&]() { return reduction::reduce<reduction::cascade, reduction::openmp>(values); }, result);
+    std::cout << "Parallel cascade sum " << std::fixed << std::setprecision(40) << result 
+              << (result == cascade_result ? " (identical to serial)" : " (differs from serial)") << std::endl;
+    test_exact_sum(values, type_);
+    test_mixed_precision(values, type_);
 }
 
 
 int main() {
     omp_set_num_threads(10);
+    const std::string binding = pin_threads();
     #pragma omp parallel
     if (omp_get_thread_num() == 0) {
         std::cout << "OpenMP float test using " << omp_get_num_threads() << " threads" << std::endl;
     }
+    std::cout << "Thread binding: " << binding << ", parallel first-touch: " 
+              << (numa_first_touch_enabled() ? "on" : "off") << std::endl;
+    #pragma omp parallel
+    {
+        const int cpu = current_cpu();
+        #pragma omp critical
+        std::cout << "Thread " << omp_get_thread_num() << " on CPU " << cpu 
+                  << " (socket " << socket_of_cpu(cpu) << ")" << std::endl;
+    }
 
     std::cout << "Float:" << std::endl;
-    perform_test<float>();
+    perform_test<float>("float");
     std::cout << std::endl;
 
     std::cout << "Double:" << std::endl;
-    perform_test<double>();
+    perform_test<double>("double");
     std::cout << std::endl;
 
     std::cout << "Long double:" << std::endl;
-    perform_test<long double>();
+    perform_test<long double>("long double");
     std::cout << std::endl;
+
+    benchmark_report().write("test_kahan_summation");
 }
@@ -30,33 +30,58 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
 
-#ifdef _WIN32
-#include <Windows.h>
-#else
-#include <unistd.h>
-#endif
+#include "benchmark.h"
+#include "perf_counters.h"
+#include "arena.h"
+#include "reduction.h"
 
 /**
-  * Sleeps for ms milliseconds
+  * Sums one value per cache line, visiting every (4 KiB) page in the
+  * random order_ before moving on to the next line. With small pages
+  * nearly every load then needs a page translation which is not in the
+  * TLB, and the prefetchers cannot guess the next page.
   */
-void cross_platform_sleep_ms(const unsigned int& ms) {
-#ifdef _WIN32
-    Sleep(ms);
-#else
-    const unsigned int ms_to_us = 1000;
-    usleep(ms*ms_to_us);
-#endif
+template <typename T, class Allocator>
+T page_strided_sum(const std::vector<T, Allocator>& values_, const std::vector<unsigned int>& order_) {
+    const size_t page = 4096/sizeof(T);
+    const size_t line = 64/sizeof(T);
+    T sum = 0.0;
+    for (size_t offset=0; offset<page; offset += line) {
+        for (size_t p=0; p<order_.size(); ++p) {
+            sum += values_[order_[p]*page + offset];
+        }
+    }
+    return sum;
+}
+
+/**
+  * Prints the resident set of the process and the pages
+  * backing the buffer which starts at start_
+  */
+void print_memory_use(const void* start_, size_t resident_before_) {
+    const double bytes_to_megabytes = 1.0/(1024.0*1024.0);
+    const size_t resident = resident_set_bytes();
+    const page_usage usage = mapping_page_usage(start_);
+    std::cout << "Resident set: " << resident*bytes_to_megabytes << " MB (" << std::showpos 
+              << (static_cast<double>(resident) - static_cast<double>(resident_before_))*bytes_to_megabytes 
+              << std::noshowpos << " MB), buffer resident in " << usage.small_pages() << " small pages and " 
+              << usage.huge_pages() << " huge pages" << std::endl;
 }
 
 /**
   * Tests how much memory an allocation takes for
-  * different basic variables
+  * different basic variables, and how the pages backing
+  * it affect the throughput
   */
 template <typename T>
-void allocation_test() {
+void allocation_test(const std::string& type_) {
     const unsigned int num_values = 10000000;
     const double bytes_to_megabytes = 1.0/(1024.0*1024.0);
+    const size_t resident_before = resident_set_bytes();
     std::vector<T> values(0);
     values.resize(num_values);
 
@@ -68,23 +93,72 @@ void allocation_test() {
     std::cout << "Address of last element: " << end << std::endl;
     std::cout << "Size of each element (bytes): " << sizeof(values[0]) << std::endl;
     std::cout << "Bytes allocated: " << bytes_allocated << " (" << bytes_allocated*bytes_to_megabytes << " MB)" << std::endl;
-    std::cout << "Sleeping five seconds..." << std::endl;
-    cross_platform_sleep_ms(5000);
-    values.resize(0);
-    std::cout << "Memory freed" << std::endl << std::endl;
+    std::cout << "First element on a 64 byte boundary: " << ((reinterpret_cast<size_t>(start) % 64 == 0) ? "yes" : "no") << std::endl;
+    print_memory_use(start, resident_before);
+
+    //Time to allocate and zero-initialize (i.e., touch every page of) a vector
+    T last;
+    run_benchmark("allocate_and_initialize", type_, num_values, num_values*sizeof(T), 
+        [&]() { std::vector<T> v(num_values); return v[num_values-1]; }, last);
+
+    std::vector<T>().swap(values);
+    std::cout << "Memory freed, resident set: " << resident_set_bytes()*bytes_to_megabytes << " MB" << std::endl;
+
+    std::vector<unsigned int> order(num_values*sizeof(T)/4096);
+    srand(0); //Make sure that the random numbers are the same for each run
+    for (size_t i=0; i<order.size(); ++i) {
+        order[i] = i;
+    }
+    for (size_t i=order.size()-1; i>0; --i) {
+        std::swap(order[i], order[rand() % (i+1)]);
+    }
+    const size_t loads = order.size() * (4096/64);
+    double small_pages_time = 0.0;
+    const page_mode modes[3] = { PAGES_SMALL, PAGES_TRANSPARENT, PAGES_EXPLICIT };
+    for (int i=0; i<3; ++i) {
+        arena pool(modes[i]);
+        const arena_allocator<T> allocator(pool);
+        const std::string mode = page_mode_name(modes[i]);
+        const size_t resident_arena = resident_set_bytes();
+        std::vector<T, arena_allocator<T> > buffer(num_values, T(0.0), allocator);
+        std::fill(buffer.begin(), buffer.end(), T(1.0));
+        std::cout << "Arena with " << mode << " (got " << page_mode_name(pool.mode()) << "), first element on a "
+                  << ((reinterpret_cast<size_t>(buffer.data()) % huge_page_size == 0) ? "2 MiB" : "smaller") << " boundary" << std::endl;
+        print_memory_use(buffer.data(), resident_arena);
+
+        T result;
+        const double strided_time = run_benchmark("page_strided_sum[" + mode + "]", type_, loads, loads*64, 
+            [&]() { return page_strided_sum(buffer, order); }, result).median;
+        print_perf_counters(loads*64, false, [&]() { return page_strided_sum(buffer, order); }, result);
+        run_benchmark("sum[" + mode + "]", type_, num_values, num_values*sizeof(T), 
+            [&]() { return reduction::reduce<reduction::cascade>(buffer); }, result);
+        if (i == 0) {
+            small_pages_time = strided_time;
+        }
+        else {
+            std::cout << "Page-strided speedup over small pages: " << std::fixed << std::setprecision(2) 
+                      << small_pages_time / strided_time << std::endl;
+            std::cout.unsetf(std::ios::floatfield);
+            std::cout << std::setprecision(6);
+        }
+
+        //The arena hands the same pages out again, so only the initialization is left
+        std::vector<T, arena_allocator<T> >().swap(buffer);
+        run_benchmark("allocate_and_initialize[" + mode + " arena]", type_, num_values, num_values*sizeof(T), 
+            [&]() { std::vector<T, arena_allocator<T> > v(num_values, T(0.0), allocator); return v[num_values-1]; }, last);
+    }
+    std::cout << std::endl;
 }
 
 int main() {    
     std::cout << "Floating point versus double: Which uses more memory?" << std::endl;
-    std::cout << "Use your windows task manager or 'top' to view resource use" << std::endl;
     std::cout << std::endl;
-    cross_platform_sleep_ms(1000);
 
     std::cout << "Testing allocation of float:" << std::endl;
-    allocation_test<float>();
-
-    cross_platform_sleep_ms(2000);
+    allocation_test<float>("float");
     
     std::cout << "Testing allocation of double:" << std::endl;
-    allocation_test<double>();
+    allocation_test<double>("double");
+
+    benchmark_report().write("test_memory_allocation");
 }
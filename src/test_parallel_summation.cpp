@@ -30,42 +30,52 @@
 #include <iostream>
 #include <iomanip>
 #include <omp.h>
+#include <vector>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+#include "benchmark.h"
+#include "numa.h"
+#include "perf_counters.h"
+#include "reduction.h"
 
 
 /**
-  * Computes the sum of ten million value_'s
+  * Computes the sum of ten million value_'s with the given
+  * summation algorithm and execution
   */
-template<typename T>
+template<class Algorithm, class Execution, typename T>
 T sum_ten_million(const T& value_) {
-    unsigned int iterations = 10000000;
-    T result = 0.0;
-    for (unsigned int i = 0; i<iterations; ++i) {
-        result += value_;
-    }
-    return result;
+    const reduction::repeat_iterator<T> first(value_, 0);
+    return reduction::reduce<Algorithm, Execution>(first, first + 10000000);
 }
 
-
 /**
-  * Computes the sum of ten million value_'s
-  * in parallel
+  * Prints the speedup over one thread of each variant
   */
-template<typename T>
-T parallel_sum_ten_million(const T& value_) {
-    unsigned int iterations = 10000000;
-    T result = 0.0;
-
-    #pragma omp parallel for schedule(dynamic, 50) reduction(+:result)
-    for (int i = 0; i<iterations; ++i) {
-        result += value_;
+inline void print_scaling(const std::vector<std::string>& names_, const std::vector<std::vector<double> >& times_) {
+    std::cout << "Speedup over one thread:" << std::endl << std::setw(8) << "Threads";
+    for (size_t j=0; j<names_.size(); ++j) {
+        std::cout << std::setw(16) << names_[j];
+    }
+    std::cout << std::endl << std::fixed << std::setprecision(2);
+    for (size_t i=0; i<times_.size(); ++i) {
+        std::cout << std::setw(8) << i+1;
+        for (size_t j=0; j<names_.size(); ++j) {
+            std::cout << std::setw(16) << times_[0][j] / times_[i][j];
+        }
+        std::cout << std::endl;
     }
-    return result;
 }
 
 template <typename T>
-void perform_test(const T& value_) {
+void perform_test(const T& value_, const std::string& type_) {
     const unsigned int iterations = 10;
     const unsigned int max_threads = 8;
+    T reference = 0.0;
+    bool all_identical = true;
+    std::vector<std::vector<double> > times;
     std::cout << "Floating point bits=" << sizeof(T)*8 << std::endl;
     for (unsigned int i=1; i<max_threads; ++i) {
         omp_set_num_threads(i);
@@ -75,26 +85,95 @@ void perform_test(const T& value_) {
         }
 
         for (unsigned int j=0; j<iterations; ++j) {
-            T result = parallel_sum_ten_million(value_);
-            std::cout << "`-> Run " << j << ": " << std::fixed << std::setprecision(25) << result << std::endl;
+            T result = sum_ten_million<reduction::naive, reduction::openmp>(value_);
+            T reproducible_result = sum_ten_million<reduction::pairwise, reduction::openmp>(value_);
+            T stealing_result = sum_ten_million<reduction::naive, reduction::work_stealing>(value_);
+            T reproducible_stealing_result = sum_ten_million<reduction::pairwise, reduction::work_stealing>(value_);
+
+            if (i == 1 && j == 0) {
+                reference = reproducible_result;
+            }
+            all_identical = all_identical && (reproducible_result == reference) && (reproducible_stealing_result == reference);
+
+            std::cout << "`-> Run " << j << ": " << std::fixed << std::setprecision(25) << result 
+                      << ", reproducible: " << reproducible_result << ", work-stealing: " << stealing_result << std::endl;
         }
+
+        T result;
+        std::vector<double> medians;
+        medians.push_back(run_benchmark("parallel_sum_ten_million", type_, 10000000, 0, [&]() { return sum_ten_million<reduction::naive, reduction::openmp>(value_); }, result).median);
+        print_perf_counters(0, true, [&]() { return sum_ten_million<reduction::naive, reduction::openmp>(value_); }, result);
+        medians.push_back(run_benchmark("reproducible_parallel_sum_ten_million", type_, 10000000, 0, [&]() { return sum_ten_million<reduction::pairwise, reduction::openmp>(value_); }, result).median);
+        print_perf_counters(0, true, [&]() { return sum_ten_million<reduction::pairwise, reduction::openmp>(value_); }, result);
+        medians.push_back(run_benchmark("work_stealing_sum_ten_million", type_, 10000000, 0, [&]() { return sum_ten_million<reduction::naive, reduction::work_stealing>(value_); }, result).median);
+        print_perf_counters(0, true, [&]() { return sum_ten_million<reduction::naive, reduction::work_stealing>(value_); }, result);
+        medians.push_back(run_benchmark("reproducible_work_stealing_sum_ten_million", type_, 10000000, 0, [&]() { return sum_ten_million<reduction::pairwise, reduction::work_stealing>(value_); }, result).median);
+        print_perf_counters(0, true, [&]() { return sum_ten_million<reduction::pairwise, reduction::work_stealing>(value_); }, result);
+        times.push_back(medians);
     }
+    std::cout << "Reproducible sum identical for all thread counts: " << (all_identical ? "yes" : "no") << std::endl;
+
+    std::vector<std::string> names;
+    names.push_back("dynamic,50");
+    names.push_back("static");
+    names.push_back("work-stealing");
+    names.push_back("ws reproducible");
+    print_scaling(names, times);
+}
+
+/**
+  * Kahan sums where the first quarter of the values are tiny, so that
+  * their compensation terms are subnormal and about ten times as slow.
+  * A static partition leaves the threads with the fast values waiting.
+  */
+void irregular_load_test() {
+    const unsigned int max_threads = 8;
+    std::vector<double, first_touch_allocator<double> > values(10000000);
+    srand(0); //Make sure that the random numbers are the same for each run
+    for (size_t i=0; i<values.size(); ++i) {
+        const double r = rand() / static_cast<double>(RAND_MAX);
+        values[i] = (i < values.size()/4) ? (1.0 + 1023.0*r) * std::numeric_limits<double>::min() : r;
+    }
+
+    const size_t bytes = values.size()*sizeof(double);
+    std::vector<std::vector<double> > times;
+    for (unsigned int i=1; i<max_threads; ++i) {
+        omp_set_num_threads(i);
+        double result;
+        std::vector<double> medians;
+        medians.push_back(run_benchmark("irregular_kahan_sum", "double", values.size(), bytes, 
+            [&]() { return reduction::reduce<reduction::kahan, reduction::openmp>(values); }, result).median);
+        medians.push_back(run_benchmark("irregular_work_stealing_kahan_sum", "double", values.size(), bytes, 
+            [&]() { return reduction::reduce<reduction::kahan, reduction::work_stealing>(values); }, result).median);
+        times.push_back(medians);
+    }
+
+    std::vector<std::string> names;
+    names.push_back("static");
+    names.push_back("work-stealing");
+    print_scaling(names, times);
 }
 
 
 int main() {    
     float value_f = 0.1f;
     std::cout << "Float:" << std::endl;
-    perform_test(value_f);
+    perform_test(value_f, "float");
     std::cout << std::endl;
     
     double value_d = 0.1;
     std::cout << "Double:" << std::endl;
-    perform_test(value_d);
+    perform_test(value_d, "double");
     std::cout << std::endl;
     
     long double value_ld = 0.1;
     std::cout << "Long double:" << std::endl;
-    perform_test(value_ld);
+    perform_test(value_ld, "long double");
     std::cout << std::endl;
+
+    std::cout << "Irregular load (Kahan sum, first quarter subnormal-heavy):" << std::endl;
+    irregular_load_test();
+    std::cout << std::endl;
+
+    benchmark_report().write("test_parallel_summation");
 }
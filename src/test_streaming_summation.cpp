@@ -0,0 +1,163 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#include <iostream>
+#include <iomanip>
+#include <omp.h>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "benchmark.h"
+#include "chunked_file.h"
+#include "compensated_summation.h"
+#include "numa.h"
+#include "random.h"
+#include "reduction.h"
+
+/**
+  * Values per chunk: 4 or 8 MB, a multiple of the page size,
+  * the SIMD lanes and the block size of the pairwise sum,
+  * so that the streamed results are identical to the in-memory ones
+  */
+static const size_t chunk_elements = 1 << 20;
+
+template <typename T>
+T streaming_sum(const std::string& filename_, chunk_read_mode mode_) {
+    T result = 0.0;
+    for_each_chunk<T>(filename_, chunk_elements, mode_, [&](const T* values_, size_t n_) {
+        result = reduction::naive_accumulate(values_, values_ + n_, result);
+    });
+    return result;
+}
+
+template <typename T>
+T streaming_kahan_sum(const std::string& filename_, chunk_read_mode mode_) {
+    compensated_lanes<T> state;
+    for_each_chunk<T>(filename_, chunk_elements, mode_, [&](const T* values_, size_t n_) {
+        kahan_accumulate(state, values_, n_);
+    });
+    return state.result().value();
+}
+
+template <typename T>
+T streaming_reproducible_sum(const std::string& filename_, chunk_read_mode mode_) {
+    reduction::pairwise_tree<T> tree;
+    for_each_chunk<T>(filename_, chunk_elements, mode_, [&](const T* values_, size_t n_) {
+        reduction::pairwise_accumulate(tree, values_, values_ + n_, true);
+    });
+    return tree.result();
+}
+
+/**
+  * Number of values in the file, set by STREAMING_ELEMENTS
+  */
+inline size_t streaming_elements() {
+    const char* setting = getenv("STREAMING_ELEMENTS");
+    return (setting != NULL) ? strtoull(setting, NULL, 10) : 10000000;
+}
+
+inline std::string streaming_filename(const std::string& type_) {
+    const char* directory = getenv("TMPDIR");
+    std::string filename = (directory != NULL) ? directory : "/tmp";
+    return filename + "/test_streaming_summation_" + type_ + ".bin";
+}
+
+template <typename T>
+void perform_test(const std::string& type_) {
+    std::vector<T, first_touch_allocator<T> > values(streaming_elements());
+    fill_random(values);
+
+    const std::string filename = streaming_filename(type_);
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == NULL || fwrite(values.data(), sizeof(T), values.size(), file) != values.size()) {
+        std::cout << "Could not write " << filename << std::endl;
+        if (file != NULL) fclose(file);
+        return;
+    }
+    fclose(file);
+
+    const size_t n = values.size();
+    const size_t bytes = n*sizeof(T);
+    std::cout << "Floating point bits=" << sizeof(T)*8 << ", " << bytes/(1024*1024) << " MB in " << filename << std::endl;
+
+    T serial_result, kahan_result, reproducible_result;
+    run_benchmark("memory_sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::naive>(values); }, serial_result);
+    run_benchmark("memory_serial_kahan_sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::kahan>(values); }, kahan_result);
+    run_benchmark("memory_reproducible_sum", type_, n, bytes, [&]() { return reduction::reduce<reduction::pairwise, reduction::openmp>(values); }, reproducible_result);
+
+    //The file is evicted from the page cache before every pass,
+    //so that the streaming runs are timed reading from disk
+    const chunk_read_mode modes[] = { CHUNK_MMAP, CHUNK_READ };
+    for (int i=0; i<2; ++i) {
+        const chunk_read_mode mode = modes[i];
+        const std::string name = chunk_read_mode_name(mode);
+        T result;
+        run_benchmark("streaming_sum[" + name + "]", type_, n, bytes, [&]() { 
+            evict_file_cache(filename); 
+            return streaming_sum<T>(filename, mode); 
+        }, result);
+        std::cout << "Streaming sum (" << name << ") " << std::fixed << std::setprecision(40) << result 
+                  << (result == serial_result ? " identical" : " differs") << std::endl;
+
+        run_benchmark("streaming_kahan_sum[" + name + "]", type_, n, bytes, [&]() { 
+            evict_file_cache(filename); 
+            return streaming_kahan_sum<T>(filename, mode); 
+        }, result);
+        std::cout << "Streaming Kahan sum (" << name << ") " << std::fixed << std::setprecision(40) << result 
+                  << (result == kahan_result ? " identical" : " differs") << std::endl;
+
+        run_benchmark("streaming_reproducible_sum[" + name + "]", type_, n, bytes, [&]() { 
+            evict_file_cache(filename); 
+            return streaming_reproducible_sum<T>(filename, mode); 
+        }, result);
+        std::cout << "Streaming reproducible sum (" << name << ") " << std::fixed << std::setprecision(40) << result 
+                  << (result == reproducible_result ? " identical" : " differs") << std::endl;
+    }
+
+    std::remove(filename.c_str());
+}
+
+
+int main() {
+    omp_set_num_threads(10);
+    const std::string binding = pin_threads();
+    std::cout << "Thread binding: " << binding << ", chunk size: " << chunk_elements << " values" << std::endl;
+
+    std::cout << "Float:" << std::endl;
+    perform_test<float>("float");
+    std::cout << std::endl;
+
+    std::cout << "Double:" << std::endl;
+    perform_test<double>("double");
+    std::cout << std::endl;
+
+    benchmark_report().write("test_streaming_summation");
+}
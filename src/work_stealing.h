@@ -0,0 +1,160 @@
+/**
+  * Copyright (c) 2013, Andr R. Brodtkorb <babrodtk@ifi.uio.no>
+  * All rights reserved.
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted provided that the following conditions are met:
+  *
+  * 1. Redistributions of source code must retain the above copyright notice, this
+  *    list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  * The views and conclusions contained in the software and documentation are those
+  * of the authors and should not be interpreted as representing official policies,
+  * either expressed or implied, of the FreeBSD Project.
+  */
+
+#ifndef WORK_STEALING_H_
+#define WORK_STEALING_H_
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <omp.h>
+
+#include "numa.h"
+
+namespace detail {
+
+/**
+  * Double-ended queue of index ranges owned by one thread. The owner
+  * pushes and pops at the back, and thieves steal the oldest (largest)
+  * range from the front. The size is kept separately so that the owner
+  * can check for an empty deque without taking the lock.
+  */
+class alignas(64) range_deque {
+public:
+    range_deque() : count(0) {}
+
+    void push(size_t begin_, size_t end_) {
+        std::lock_guard<std::mutex> guard(lock);
+        ranges.push_back(std::make_pair(begin_, end_));
+        count.store(ranges.size(), std::memory_order_relaxed);
+    }
+
+    bool pop(size_t& begin_, size_t& end_) {
+        if (empty()) return false;
+        std::lock_guard<std::mutex> guard(lock);
+        if (ranges.empty()) return false;
+        begin_ = ranges.back().first;
+        end_ = ranges.back().second;
+        ranges.pop_back();
+        count.store(ranges.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool steal(size_t& begin_, size_t& end_) {
+        if (empty()) return false;
+        std::lock_guard<std::mutex> guard(lock);
+        if (ranges.empty()) return false;
+        begin_ = ranges.front().first;
+        end_ = ranges.front().second;
+        ranges.pop_front();
+        count.store(ranges.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool empty() const {
+        return count.load(std::memory_order_relaxed) == 0;
+    }
+
+private:
+    std::mutex lock;
+    std::deque<std::pair<size_t, size_t> > ranges;
+    std::atomic<size_t> count;
+};
+
+} //namespace detail
+
+/**
+  * Calls f_(thread, begin, end) for pieces of [0, n_) on all OpenMP threads,
+  * balancing the load by work stealing. Each thread starts with its static
+  * partition (so first-touch placement is kept when the load is even), and
+  * processes it grain_ elements at a time. Ranges are only split while some
+  * thread is out of work and looking for a victim: the upper half is pushed
+  * for thieves and the thread continues with the lower half. The grain size
+  * thus adapts to the imbalance, and an even load costs two locks per thread
+  * (the push and pop of its partition) and one relaxed atomic load per grain.
+  */
+template <class F>
+void work_stealing_for(size_t n_, size_t grain_, F f_) {
+    const int max_threads = omp_get_max_threads();
+    std::vector<detail::range_deque> deques(max_threads);
+    std::atomic<size_t> remaining(n_);
+    std::atomic<int> thieves(0);
+
+    #pragma omp parallel
+    {
+        const int num_threads = omp_get_num_threads();
+        const int thread = omp_get_thread_num();
+        detail::range_deque& own = deques[thread];
+        size_t begin, end;
+        static_partition(n_, thread, num_threads, begin, end);
+        if (end > begin) {
+            own.push(begin, end);
+        }
+        #pragma omp barrier
+
+        unsigned int victim = thread;
+        bool thief = false;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            bool found = own.pop(begin, end);
+            for (int i=1; i<num_threads && !found; ++i) {
+                victim = (victim + 1) % num_threads;
+                found = (static_cast<int>(victim) != thread) && deques[victim].steal(begin, end);
+            }
+            if (!found) {
+                if (!thief) {
+                    thief = true;
+                    thieves.fetch_add(1, std::memory_order_relaxed);
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            if (thief) {
+                thief = false;
+                thieves.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            while (begin < end) {
+                if (end - begin > 2*grain_ && own.empty() && thieves.load(std::memory_order_relaxed) > 0) {
+                    const size_t middle = begin + (end - begin)/2;
+                    own.push(middle, end);
+                    end = middle;
+                }
+                const size_t stop = (end - begin > grain_) ? begin + grain_ : end;
+                f_(thread, begin, stop);
+                remaining.fetch_sub(stop - begin, std::memory_order_release);
+                begin = stop;
+            }
+        }
+    }
+}
+
+#endif